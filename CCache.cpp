@@ -0,0 +1,135 @@
+#include "CCache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char CACHE_MAGIC[8] = {'P', 'S', '2', 'C', 'C', 'A', 'C', 'H'};
+static const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader{
+	char magic[8];
+	uint32_t version;
+	uint32_t method;
+	uint64_t entries;
+	uint64_t keys;
+};
+
+CCache::CCache():
+	m_Entries(nullptr),
+	m_Keys(nullptr),
+	m_Size(0)
+{
+}
+
+bool CCache::Open(const std::string& filename, uint32_t method){
+	m_Mapping.reset();
+	m_Entries = nullptr;
+	m_Keys = nullptr;
+	m_Size = 0;
+
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) return errno == ENOENT;
+	struct stat info;
+	if (fstat(file, &info) != 0 || (size_t)info.st_size < sizeof(CacheHeader)){
+		close(file);
+		return false;
+	}
+	size_t size = info.st_size;
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapping == MAP_FAILED) return false;
+	std::shared_ptr<const char> data(static_cast<const char*>(mapping), [size](const char* p){
+		munmap(const_cast<char*>(p), size);
+	});
+
+	CacheHeader header;
+	std::memcpy(&header, data.get(), sizeof(header));
+	if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+		|| header.version != CACHE_VERSION
+		|| header.method != method) return false;
+	if (header.entries > size / sizeof(Entry) || header.keys > size / sizeof(uint32_t)
+		|| sizeof(header) + header.entries * sizeof(Entry) + header.keys * sizeof(uint32_t) != size) return false;
+
+	const Entry* entries = reinterpret_cast<const Entry*>(data.get() + sizeof(header));
+	for (uint64_t i = 0; i < header.entries; ++i){
+		if (entries[i].key > header.keys || entries[i].length > header.keys - entries[i].key) return false;
+	}
+
+	m_Mapping = data;
+	m_Entries = entries;
+	m_Keys = reinterpret_cast<const uint32_t*>(entries + header.entries);
+	m_Size = header.entries;
+	return true;
+}
+
+bool CCache::Less(const Entry& entry, const std::vector<unsigned int>& X) const{
+	return std::lexicographical_compare(m_Keys + entry.key, m_Keys + entry.key + entry.length, X.begin(), X.end());
+}
+
+bool CCache::Find(const std::vector<unsigned int>& X, double& value) const{
+	const Entry* end = m_Entries + m_Size;
+	const Entry* entry = std::lower_bound(m_Entries, end, X, [this](const Entry& e, const std::vector<unsigned int>& x){
+		return Less(e, x);
+	});
+	if (entry == end || entry->length != X.size() || !std::equal(X.begin(), X.end(), m_Keys + entry->key)) return false;
+	value = entry->value;
+	return true;
+}
+
+uint64_t CCache::Size() const{
+	return m_Size;
+}
+
+bool CCache::Save(const std::string& filename, uint32_t method, const std::map<std::vector<unsigned int>, double>& values){
+	// Other runs may have saved since we opened it, so merge with the current file
+	CCache stored;
+	if (!stored.Open(filename, method)) stored = CCache();
+
+	std::vector<Entry> entries;
+	std::vector<uint32_t> keys;
+	auto add = [&](const uint32_t* key, uint32_t length, double value){
+		entries.push_back(Entry{keys.size(), length, 0, value});
+		keys.insert(keys.end(), key, key + length);
+	};
+	uint64_t i = 0;
+	auto v = values.begin();
+	while (i < stored.m_Size || v != values.end()){
+		if (v == values.end() || (i < stored.m_Size && stored.Less(stored.m_Entries[i], v->first))){
+			const Entry& e = stored.m_Entries[i++];
+			add(stored.m_Keys + e.key, e.length, e.value);
+		} else {
+			std::vector<uint32_t> key(v->first.begin(), v->first.end());
+			add(key.data(), key.size(), v->second);
+			if (i < stored.m_Size && stored.m_Entries[i].length == key.size()
+				&& std::equal(key.begin(), key.end(), stored.m_Keys + stored.m_Entries[i].key)) i++;
+			v++;
+		}
+	}
+
+	CacheHeader header;
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.method = method;
+	header.entries = entries.size();
+	header.keys = keys.size();
+
+	std::string temporary = filename + ".tmp" + std::to_string(getpid());
+	std::ofstream file(temporary, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+	file.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint32_t));
+	file.close();
+	if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0){
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+#ifndef CCACHE_H
+#define CCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Permutation probabilities stored on disk between runs. The file holds a
+// versioned header naming the method the values were computed with, then
+// the entries sorted by count vector, so it is mapped and searched in place
+// and safe to read from any thread.
+class CCache{
+	private:
+		struct Entry{
+			uint64_t key;
+			uint32_t length;
+			uint32_t unused;
+			double value;
+		};
+
+		std::shared_ptr<const char> m_Mapping;
+		const Entry* m_Entries;
+		const uint32_t* m_Keys;
+		uint64_t m_Size;
+
+		bool Less(const Entry& entry, const std::vector<unsigned int>& X) const;
+
+	public:
+		CCache();
+
+		// Map a cache file for the given method. A missing file is an empty
+		// cache, false if the file is invalid, of another version or method.
+		bool Open(const std::string& filename, uint32_t method);
+		// Look up the value stored for a sorted count vector
+		bool Find(const std::vector<unsigned int>& X, double& value) const;
+		uint64_t Size() const;
+
+		// Merge values into the cache file as it is on disk now, replacing it
+		// at once so concurrent readers see the old or the new file
+		static bool Save(const std::string& filename, uint32_t method, const std::map<std::vector<unsigned int>, double>& values);
+};
+#endif
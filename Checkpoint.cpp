@@ -0,0 +1,178 @@
+#include "Checkpoint.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char CHECKPOINT_MAGIC[8] = {'P', 'S', '2', 'C', 'H', 'K', 'P', 'T'};
+static const uint32_t CHECKPOINT_VERSION = 1;
+// Bytes before the offset that have to be unchanged
+static const uint64_t TAIL_BYTES = 1 << 16;
+
+struct CheckpointHeader{
+	char magic[8];
+	uint32_t version;
+	uint32_t method;
+	uint32_t fixedKernels;
+	uint32_t patterns;
+	uint64_t offset;
+	uint64_t tailHash;
+	uint64_t shape;
+};
+
+Checkpoint::Checkpoint(std::string filename):
+	m_Filename(filename),
+	m_Offset(0)
+{
+}
+
+uint64_t Checkpoint::TailHash(const std::string& data, uint64_t offset, bool& valid){
+	// FNV-1a of the bytes before the offset
+	uint64_t hash = 14695981039346656037ull;
+	uint64_t begin = (offset > TAIL_BYTES ? offset - TAIL_BYTES : 0);
+	std::vector<char> bytes(offset - begin);
+	std::ifstream file(data, std::ios::binary);
+	file.seekg(begin);
+	valid = (bool)file.read(bytes.data(), bytes.size());
+	for (char c: bytes){
+		hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+	}
+	return hash;
+}
+
+bool Checkpoint::Restore(PatternSet& patterns, std::map<unsigned int, unsigned int>& shape, const std::string& data, std::string& error){
+	m_Offset = 0;
+	struct stat info;
+	if (stat(m_Filename.c_str(), &info) != 0 && errno == ENOENT) return true;
+	std::ifstream file(m_Filename, std::ios::binary);
+
+	CheckpointHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0
+		|| header.version != CHECKPOINT_VERSION){
+		error = "it is not a checkpoint of this version";
+		return false;
+	}
+	if (header.method != Pattern::CMethodId() || header.fixedKernels != Pattern::FixedKernels()){
+		error = "it was computed with other permutation probability options";
+		return false;
+	}
+	if (header.patterns != patterns.Size()){
+		error = "it holds " + std::to_string(header.patterns) + " patterns instead of " + std::to_string(patterns.Size());
+		return false;
+	}
+	bool valid;
+	if (TailHash(data, header.offset, valid) != header.tailHash || !valid){
+		error = "the data before its offset " + std::to_string(header.offset) + " changed";
+		return false;
+	}
+
+	for (uint64_t i = 0; i < header.shape; ++i){
+		std::pair<unsigned int, unsigned int> entry;
+		file.read(reinterpret_cast<char*>(&entry.first), sizeof(entry.first));
+		file.read(reinterpret_cast<char*>(&entry.second), sizeof(entry.second));
+		shape[entry.first] += entry.second;
+	}
+	for (auto& p: patterns.Patterns()){
+		uint32_t symbols = 0;
+		file.read(reinterpret_cast<char*>(&symbols), sizeof(symbols));
+		bool same = file && symbols == p.Symbols().size();
+		for (uint32_t i = 0; i < symbols && same; ++i){
+			uint32_t length = 0;
+			file.read(reinterpret_cast<char*>(&length), sizeof(length));
+			std::string symbol(file ? length : 0, '\0');
+			file.read(&symbol[0], symbol.size());
+			same = file && symbol == p.Symbols()[i];
+		}
+		if (!same){
+			error = "it does not hold the pattern " + p.ToString();
+			return false;
+		}
+		if (!p.ReadState(file)){
+			error = "it is truncated";
+			return false;
+		}
+	}
+	m_Offset = header.offset;
+	return true;
+}
+
+uint64_t Checkpoint::Offset() const{
+	return m_Offset;
+}
+
+bool Checkpoint::Store(const PatternSet& patterns, const std::map<unsigned int, unsigned int>& shape, const std::string& data, uint64_t offset){
+	CheckpointHeader header;
+	std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	header.version = CHECKPOINT_VERSION;
+	header.method = Pattern::CMethodId();
+	header.fixedKernels = Pattern::FixedKernels();
+	header.patterns = patterns.Size();
+	header.offset = offset;
+	bool valid;
+	header.tailHash = TailHash(data, offset, valid);
+	header.shape = shape.size();
+	if (!valid) return false;
+
+	// Write next to the old checkpoint and replace it at once
+	std::string temporary = m_Filename + ".tmp" + std::to_string(getpid());
+	std::ofstream file(temporary, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (auto const& entry: shape){
+		file.write(reinterpret_cast<const char*>(&entry.first), sizeof(entry.first));
+		file.write(reinterpret_cast<const char*>(&entry.second), sizeof(entry.second));
+	}
+	for (auto const& p: patterns.Patterns()){
+		uint32_t symbols = p.Symbols().size();
+		file.write(reinterpret_cast<const char*>(&symbols), sizeof(symbols));
+		for (auto const& symbol: p.Symbols()){
+			uint32_t length = symbol.size();
+			file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+			file.write(symbol.data(), length);
+		}
+		p.WriteState(file);
+	}
+	file.close();
+	if (!file || std::rename(temporary.c_str(), m_Filename.c_str()) != 0){
+		std::remove(temporary.c_str());
+		return false;
+	}
+	m_Offset = offset;
+	return true;
+}
+
+bool Checkpoint::CompleteLines(const std::string& data, uint64_t& end){
+	int file = open(data.c_str(), O_RDONLY);
+	if (file < 0) return false;
+	struct stat info;
+	if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode)){
+		close(file);
+		return false;
+	}
+
+	// Search backwards for the last line separator
+	end = info.st_size;
+	char buffer[1 << 16];
+	while (end > 0){
+		uint64_t begin = (end > sizeof(buffer) ? end - sizeof(buffer) : 0);
+		ssize_t bytes = pread(file, buffer, end - begin, begin);
+		if (bytes != (ssize_t)(end - begin)){
+			close(file);
+			return false;
+		}
+		const char* separator = static_cast<const char*>(memrchr(buffer, '\n', bytes));
+		if (separator != nullptr){
+			end = begin + (separator - buffer) + 1;
+			break;
+		}
+		end = begin;
+	}
+	close(file);
+	return true;
+}
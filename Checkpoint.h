@@ -0,0 +1,36 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "PatternSet.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Per pattern sums over the lines of a growing sequence file up to an offset,
+// so a later run only processes the lines appended since. The checkpoint
+// remembers the C method and a hash of the data just before the offset, and
+// is only restored for the same patterns, method and unchanged data.
+class Checkpoint{
+	private:
+		std::string m_Filename;
+		uint64_t m_Offset;
+
+		static uint64_t TailHash(const std::string& data, uint64_t offset, bool& valid);
+
+	public:
+		Checkpoint(std::string filename);
+
+		// Restore the pattern sums and database shape. A missing checkpoint file
+		// starts at offset 0, false with a reason if it does not fit.
+		bool Restore(PatternSet& patterns, std::map<unsigned int, unsigned int>& shape, const std::string& data, std::string& error);
+		// Offset up to which the data was processed
+		uint64_t Offset() const;
+		// Replace the checkpoint file with the sums up to a new offset
+		bool Store(const PatternSet& patterns, const std::map<unsigned int, unsigned int>& shape, const std::string& data, uint64_t offset);
+
+		// Offset after the last complete line of a regular file, a line still
+		// being written is left for a later run
+		static bool CompleteLines(const std::string& data, uint64_t& end);
+};
+#endif
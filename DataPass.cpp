@@ -0,0 +1,241 @@
+#include "DataPass.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+// The -v sequence counter, printed at most every 100 ms as flushing the line
+// for every sequence is a measurable cost
+class ProgressLine{
+	private:
+		bool m_Enabled;
+		unsigned int m_Checks;
+		std::chrono::steady_clock::time_point m_Last;
+
+	public:
+		ProgressLine(bool enabled):
+			m_Enabled(enabled),
+			m_Checks(0),
+			m_Last(std::chrono::steady_clock::now())
+		{
+		}
+
+		void Update(unsigned int sequences){
+			if (!m_Enabled || ++m_Checks % 64 != 0) return;
+			auto now = std::chrono::steady_clock::now();
+			if (now - m_Last < std::chrono::milliseconds(100)) return;
+			m_Last = now;
+			std::cout << "\r" << sequences << " sequences processed." << std::flush;
+		}
+
+		void Finish(unsigned int sequences){
+			if (m_Enabled) std::cout << "\r" << sequences << " sequences processed." << std::flush;
+		}
+};
+
+std::map<unsigned int, unsigned int> applyFileToPatterns(PatternSet* patterns, TokenReader* sequenceFile, const StatisticsPlan& plan, unsigned int verbose){
+	// Iterate sequences
+	std::map<unsigned int, unsigned int> databaseShape;
+	#ifdef SIGSPAN
+	unsigned int sequenceLength = 0;
+	#endif
+
+	unsigned int sequenceCounter = 0;
+	ProgressLine progress(verbose == 1);
+	std::string_view newItem;
+	while (sequenceFile->Item(newItem)){
+		if (newItem == "\n"){
+			if (verbose >= 2) std::cout << std::endl;
+			sequenceCounter++;
+
+			#ifdef SIGSPAN
+			if (databaseShape.find(sequenceLength) == databaseShape.end()){
+				databaseShape[sequenceLength] = 0;
+			}
+			databaseShape[sequenceLength]++;
+			sequenceLength = 0;
+			#endif
+
+			patterns->Process(plan);
+			METRIC_ADD(SEQUENCES, 1);
+			progress.Update(sequenceCounter);
+		} else {
+			#ifdef SIGSPAN
+			sequenceLength++;
+			#endif
+
+			if (verbose >= 2) std::cout << newItem << " ";
+			patterns->SymbolSeen(newItem);
+			METRIC_ADD(TOKENS, 1);
+		}
+	}
+	progress.Finish(sequenceCounter);
+	if (verbose >= 1) std::cout << std::endl;
+	patterns->ShareGroups();
+
+	return databaseShape;
+}
+
+std::map<unsigned int, unsigned int> applyDatasetToPatterns(PatternSet* patterns, const Dataset* dataset, const StatisticsPlan& plan, unsigned int verbose){
+	// Iterate sequences
+	std::map<unsigned int, unsigned int> databaseShape;
+	#ifdef SIGSPAN
+	databaseShape = dataset->Shape();
+	#endif
+
+	ProgressLine progress(verbose == 1);
+	for (unsigned int i = 0; i < dataset->Sequences(); ++i){
+		for (const unsigned int* s = dataset->Begin(i); s != dataset->End(i); ++s){
+			if (verbose >= 2) std::cout << patterns->Symbols().Name(*s) << " ";
+			patterns->SymbolSeen(*s);
+		}
+
+		if (verbose >= 2) std::cout << std::endl;
+		patterns->Process(plan);
+		METRIC_ADD(SEQUENCES, 1);
+		METRIC_ADD(TOKENS, dataset->End(i) - dataset->Begin(i));
+		progress.Update(i + 1);
+	}
+	progress.Finish(dataset->Sequences());
+	if (verbose >= 1) std::cout << std::endl;
+	patterns->ShareGroups();
+
+	return databaseShape;
+}
+
+void runParallel(unsigned int tasks, unsigned int threads, std::function<void(unsigned int)> task){
+	// Hand out tasks from a counter, worker C/G caches end up in the calling thread
+	std::atomic<unsigned int> next(0);
+	auto worker = [&](){
+		unsigned int i;
+		while ((i = next++) < tasks){
+			task(i);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	std::vector<Pattern::Cache> caches(threads - 1);
+	for (unsigned int i = 0; i + 1 < threads; ++i){
+		pool.emplace_back([&, i](){
+			worker();
+			caches[i] = Pattern::TakeCache();
+		});
+	}
+	worker();
+	for (unsigned int i = 0; i < pool.size(); ++i){
+		pool[i].join();
+		Pattern::MergeCache(caches[i]);
+	}
+}
+
+std::map<unsigned int, unsigned int> applyDatasetToPatternsParallel(PatternSet* patterns, const Dataset* dataset, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose){
+	// Patterns only keep their own state, so disjoint shards can be scored
+	// concurrently. Use several shards per thread to balance uneven patterns.
+	unsigned int shards = std::min(patterns->Size(), 4 * threads);
+	unsigned int done = 0;
+	std::mutex progress;
+
+	runParallel(shards, threads, [&](unsigned int shard){
+		unsigned int first = (unsigned long) patterns->Size() * shard / shards;
+		unsigned int last = (unsigned long) patterns->Size() * (shard + 1) / shards;
+		patterns->ApplyShard(*dataset, first, last, plan);
+
+		std::lock_guard<std::mutex> lock(progress);
+		done++;
+		if (verbose >= 1) std::cout << "\r" << done << "/" << shards << " pattern shards processed." << std::flush;
+	});
+	if (verbose >= 1) std::cout << std::endl;
+	patterns->ShareGroups();
+	METRIC_ADD(SEQUENCES, dataset->Sequences());
+	METRIC_ADD(TOKENS, dataset->Sequences() > 0 ? dataset->End(dataset->Sequences() - 1) - dataset->Begin(0) : 0);
+
+	std::map<unsigned int, unsigned int> databaseShape;
+	#ifdef SIGSPAN
+	databaseShape = dataset->Shape();
+	#endif
+	return databaseShape;
+}
+
+std::map<unsigned int, unsigned int> applyChunksToPatterns(PatternSet* patterns, const char* filename, std::vector<size_t> splitPoints, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose){
+	// Score each byte range with fresh copies of the patterns, then merge the
+	// per-pattern sums in file order. Supports and probability histograms are
+	// those of a single pass, expected values and variances only up to
+	// rounding as partial sums are added.
+	unsigned int chunks = splitPoints.size() - 1;
+	std::vector<PatternSet> chunkPatterns(chunks, PatternSet(0));
+	std::vector<std::map<unsigned int, unsigned int>> chunkShapes(chunks);
+	unsigned int done = 0;
+	std::mutex progress;
+
+	runParallel(chunks, threads, [&](unsigned int chunk){
+		for (auto const& p: patterns->Patterns()){
+			chunkPatterns[chunk].Add(p.Symbols());
+		}
+		TokenReader reader(filename, ' ', '\n');
+		reader.SetRange(splitPoints[chunk], splitPoints[chunk + 1]);
+		chunkShapes[chunk] = applyFileToPatterns(&chunkPatterns[chunk], &reader, plan, 0);
+
+		std::lock_guard<std::mutex> lock(progress);
+		done++;
+		if (verbose >= 1) std::cout << "\r" << done << "/" << chunks << " chunks processed." << std::flush;
+	});
+	if (verbose >= 1) std::cout << std::endl;
+
+	std::map<unsigned int, unsigned int> databaseShape;
+	for (unsigned int chunk = 0; chunk < chunks; ++chunk){
+		for (unsigned int i = 0; i < patterns->Size(); ++i){
+			patterns->Patterns()[i].Merge(chunkPatterns[chunk].Patterns()[i]);
+		}
+		for (auto const& x: chunkShapes[chunk]){
+			databaseShape[x.first] += x.second;
+		}
+	}
+	return databaseShape;
+}
+
+std::map<unsigned int, unsigned int> applyRangeToPatterns(PatternSet* patterns, const char* filename, uint64_t begin, uint64_t end, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose){
+	// Process the lines starting in [begin, end) of a regular file, adding to
+	// the sums the patterns already hold
+	std::map<unsigned int, unsigned int> databaseShape;
+	TokenReader sequenceFile(filename, ' ', '\n');
+	if (begin == end || !sequenceFile.SetRange(begin, end)) return databaseShape;
+	if (threads > 1 && verbose < 2){
+		Dataset dataset(sequenceFile, patterns->Symbols());
+		return applyDatasetToPatternsParallel(patterns, &dataset, plan, threads, verbose);
+	}
+	return applyFileToPatterns(patterns, &sequenceFile, plan, verbose);
+}
+
+void evaluateDeferred(PatternSet* patterns, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose){
+	// Each distinct vector is evaluated once for all patterns
+	std::map<std::vector<unsigned int>, double> probabilities;
+	for (auto const& p: patterns->Patterns()){
+		for (auto const& x: p.DeferredVectors()){
+			probabilities.emplace(x.first, 0.0);
+		}
+	}
+	std::vector<std::pair<const std::vector<unsigned int>, double>*> vectors;
+	for (auto& x: probabilities){
+		vectors.push_back(&x);
+	}
+	if (verbose >= 1) std::cout << vectors.size() << " distinct count vectors to evaluate." << std::endl;
+
+	// Blocks of vectors per task, threads write disjoint entries
+	const unsigned int block = 64;
+	unsigned int tasks = (vectors.size() + block - 1) / block;
+	runParallel(tasks, std::max(1u, std::min(threads, tasks)), [&](unsigned int task){
+		unsigned int last = std::min<size_t>(vectors.size(), (size_t)(task + 1) * block);
+		for (unsigned int i = task * block; i < last; ++i){
+			vectors[i]->second = Pattern::OccursProbability(vectors[i]->first);
+		}
+	});
+
+	for (auto& p: patterns->Patterns()){
+		p.FillDeferred(probabilities, plan);
+	}
+	patterns->ShareGroups();
+}
@@ -0,0 +1,36 @@
+#ifndef DATAPASS_H
+#define DATAPASS_H
+
+#include "Dataset.h"
+#include "PatternSet.h"
+#include "StatisticsPlan.h"
+#include "TokenReader.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+// Passes over the data adding to the sums of the patterns, after which group
+// members hold the statistics of their group. Each returns the number of
+// sequences per sequence length when built with SIGSPAN.
+
+// Stream sequences from a reader
+std::map<unsigned int, unsigned int> applyFileToPatterns(PatternSet* patterns, TokenReader* sequenceFile, const StatisticsPlan& plan, unsigned int verbose);
+// Iterate the sequences of an in-memory dataset
+std::map<unsigned int, unsigned int> applyDatasetToPatterns(PatternSet* patterns, const Dataset* dataset, const StatisticsPlan& plan, unsigned int verbose);
+// Score disjoint shards of the patterns on several threads
+std::map<unsigned int, unsigned int> applyDatasetToPatternsParallel(PatternSet* patterns, const Dataset* dataset, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose);
+// Stream byte ranges of a mapped file on several threads
+std::map<unsigned int, unsigned int> applyChunksToPatterns(PatternSet* patterns, const char* filename, std::vector<size_t> splitPoints, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose);
+// Process the lines starting in [begin, end) of a regular file
+std::map<unsigned int, unsigned int> applyRangeToPatterns(PatternSet* patterns, const char* filename, uint64_t begin, uint64_t end, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose);
+
+// Evaluate the distinct count vectors recorded by deferred passes on several
+// threads and add them to the sums of the patterns
+void evaluateDeferred(PatternSet* patterns, const StatisticsPlan& plan, unsigned int threads, unsigned int verbose);
+
+// Run tasks 0 .. tasks-1 on a number of threads, worker C/G caches end up
+// in the calling thread
+void runParallel(unsigned int tasks, unsigned int threads, std::function<void(unsigned int)> task);
+#endif
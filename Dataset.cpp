@@ -0,0 +1,203 @@
+#include "Dataset.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Compiled layout: header, '\0' terminated symbol names padded to 8 bytes,
+// sequences + 1 offsets, then one 32 bit id per symbol occurrence
+static const char COMPILED_MAGIC[8] = {'P', 'S', '2', 'D', 'A', 'T', 'A', '\0'};
+static const uint32_t COMPILED_VERSION = 1;
+
+struct CompiledHeader{
+	char magic[8];
+	uint32_t version;
+	uint32_t idBytes;
+	uint64_t symbols;
+	uint64_t sequences;
+	uint64_t occurrences;
+	uint64_t dictionaryBytes;
+};
+
+static uint64_t padded(uint64_t bytes){
+	return (bytes + 7) / 8 * 8;
+}
+
+Dataset::Dataset():
+	m_MappedSymbols(nullptr),
+	m_MappedOffsets(nullptr),
+	m_MappedSequences(0)
+{
+	m_Offsets.push_back(0);
+}
+
+Dataset::Dataset(TokenReader& reader, SymbolTable& symbols):
+	Dataset{}
+{
+	std::string_view item;
+	while (reader.Item(item)){
+		if (item == "\n"){
+			m_Offsets.push_back(m_Symbols.size());
+		} else {
+			m_Symbols.push_back(symbols.Intern(item));
+		}
+	}
+}
+
+void Dataset::Append(const std::vector<unsigned int>& sequence){
+	m_Symbols.insert(m_Symbols.end(), sequence.begin(), sequence.end());
+	m_Offsets.push_back(m_Symbols.size());
+}
+
+bool Dataset::IsCompiled(const std::string& filename){
+	if (filename == "-") return false;
+	std::ifstream file(filename, std::ios::binary);
+	char magic[sizeof(COMPILED_MAGIC)];
+	if (!file.read(magic, sizeof(magic))) return false;
+	return std::memcmp(magic, COMPILED_MAGIC, sizeof(magic)) == 0;
+}
+
+bool Dataset::Load(const std::string& filename, SymbolTable& symbols){
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) return false;
+	struct stat info;
+	if (fstat(file, &info) != 0 || (size_t)info.st_size < sizeof(CompiledHeader)){
+		close(file);
+		return false;
+	}
+	size_t size = info.st_size;
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapping == MAP_FAILED) return false;
+	std::shared_ptr<const char> data(static_cast<const char*>(mapping), [size](const char* p){
+		munmap(const_cast<char*>(p), size);
+	});
+
+	// Check the header and that the sections fill the file exactly
+	CompiledHeader header;
+	std::memcpy(&header, data.get(), sizeof(header));
+	if (std::memcmp(header.magic, COMPILED_MAGIC, sizeof(COMPILED_MAGIC)) != 0
+		|| header.version != COMPILED_VERSION
+		|| header.idBytes != sizeof(unsigned int)) return false;
+	uint64_t offsetsBegin = sizeof(header) + padded(header.dictionaryBytes);
+	if (header.dictionaryBytes > size || header.sequences >= size / sizeof(uint64_t)
+		|| header.occurrences > size / sizeof(unsigned int)) return false;
+	uint64_t symbolsBegin = offsetsBegin + (header.sequences + 1) * sizeof(uint64_t);
+	if (symbolsBegin + header.occurrences * sizeof(unsigned int) != size) return false;
+
+	// Intern the dictionary, ids can be used in place if they come out unchanged
+	std::vector<unsigned int> ids;
+	const char* name = data.get() + sizeof(header);
+	const char* dictionaryEnd = name + header.dictionaryBytes;
+	bool identity = true;
+	for (uint64_t i = 0; i < header.symbols; ++i){
+		const char* end = static_cast<const char*>(std::memchr(name, '\0', dictionaryEnd - name));
+		if (end == nullptr) return false;
+		ids.push_back(symbols.Intern(std::string_view(name, end - name)));
+		identity = identity && ids.back() == i;
+		name = end + 1;
+	}
+
+	const uint64_t* offsets = reinterpret_cast<const uint64_t*>(data.get() + offsetsBegin);
+	if (offsets[0] != 0 || offsets[header.sequences] != header.occurrences) return false;
+	for (uint64_t i = 0; i < header.sequences; ++i){
+		if (offsets[i] > offsets[i + 1]) return false;
+	}
+
+	const unsigned int* stream = reinterpret_cast<const unsigned int*>(data.get() + symbolsBegin);
+	std::vector<unsigned int> remapped;
+	if (!identity) remapped.reserve(header.occurrences);
+	for (uint64_t i = 0; i < header.occurrences; ++i){
+		if (stream[i] >= header.symbols) return false;
+		if (!identity) remapped.push_back(ids[stream[i]]);
+	}
+
+	m_Mapping = data;
+	m_MappedOffsets = offsets;
+	m_MappedSequences = header.sequences;
+	m_MappedSymbols = (identity ? stream : nullptr);
+	m_Symbols.swap(remapped);
+	m_Offsets.clear();
+	return true;
+}
+
+bool Dataset::Write(const std::string& filename, const SymbolTable& symbols) const{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) return false;
+
+	CompiledHeader header;
+	std::memcpy(header.magic, COMPILED_MAGIC, sizeof(COMPILED_MAGIC));
+	header.version = COMPILED_VERSION;
+	header.idBytes = sizeof(unsigned int);
+	header.symbols = symbols.Size();
+	header.sequences = Sequences();
+	header.occurrences = OffsetData()[Sequences()];
+	header.dictionaryBytes = 0;
+	for (unsigned int i = 0; i < symbols.Size(); ++i){
+		header.dictionaryBytes += symbols.Name(i).size() + 1;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (unsigned int i = 0; i < symbols.Size(); ++i){
+		file.write(symbols.Name(i).c_str(), symbols.Name(i).size() + 1);
+	}
+	const char padding[8] = {0};
+	file.write(padding, padded(header.dictionaryBytes) - header.dictionaryBytes);
+
+	file.write(reinterpret_cast<const char*>(OffsetData()), (header.sequences + 1) * sizeof(uint64_t));
+	file.write(reinterpret_cast<const char*>(SymbolData()), header.occurrences * sizeof(unsigned int));
+	return (bool)file;
+}
+
+const unsigned int* Dataset::SymbolData() const{
+	return (m_MappedSymbols != nullptr ? m_MappedSymbols : m_Symbols.data());
+}
+
+const uint64_t* Dataset::OffsetData() const{
+	return (m_Mapping ? m_MappedOffsets : m_Offsets.data());
+}
+
+unsigned int Dataset::Sequences() const{
+	return (m_Mapping ? m_MappedSequences : m_Offsets.size() - 1);
+}
+
+const unsigned int* Dataset::Begin(unsigned int sequence) const{
+	return SymbolData() + OffsetData()[sequence];
+}
+
+const unsigned int* Dataset::End(unsigned int sequence) const{
+	return SymbolData() + OffsetData()[sequence + 1];
+}
+
+std::map<unsigned int, unsigned int> Dataset::Shape() const{
+	std::map<unsigned int, unsigned int> shape;
+	for (unsigned int i = 0; i < Sequences(); ++i){
+		shape[End(i) - Begin(i)]++;
+	}
+	return shape;
+}
+
+void Dataset::SymbolStatistics(unsigned int symbols, std::vector<unsigned int>& sequences, std::vector<unsigned int>& maxCounts) const{
+	sequences.assign(symbols, 0);
+	maxCounts.assign(symbols, 0);
+	// Counts of the current sequence, reset through the symbols it touched
+	std::vector<unsigned int> counts(symbols, 0);
+	std::vector<unsigned int> touched;
+	for (unsigned int i = 0; i < Sequences(); ++i){
+		for (const unsigned int* symbol = Begin(i); symbol != End(i); ++symbol){
+			if (*symbol >= symbols) continue;
+			if (counts[*symbol]++ == 0) touched.push_back(*symbol);
+		}
+		for (unsigned int symbol: touched){
+			sequences[symbol]++;
+			maxCounts[symbol] = std::max(maxCounts[symbol], counts[symbol]);
+			counts[symbol] = 0;
+		}
+		touched.clear();
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include "SymbolTable.h"
+#include "TokenReader.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A sequence file held in memory as symbol ids, sequence i spans
+// [Begin(i), End(i)).
+//
+// A dataset can be compiled to a binary file holding the symbol dictionary,
+// the sequence offsets and the symbol ids as fixed width integers. Loading a
+// compiled file maps it and skips tokenization, the ids are used in place
+// when the symbol table was empty.
+class Dataset{
+	private:
+		std::vector<unsigned int> m_Symbols;
+		std::vector<uint64_t> m_Offsets;
+
+		// Mapping of a compiled file, shared between copies
+		std::shared_ptr<const char> m_Mapping;
+		const unsigned int* m_MappedSymbols;
+		const uint64_t* m_MappedOffsets;
+		uint64_t m_MappedSequences;
+
+		const unsigned int* SymbolData() const;
+		const uint64_t* OffsetData() const;
+
+	public:
+		Dataset();
+		// Read all sequences, interning every symbol
+		Dataset(TokenReader& reader, SymbolTable& symbols);
+
+		// Whether a file starts like a compiled dataset
+		static bool IsCompiled(const std::string& filename);
+		// Add a sequence to a dataset that was read, not mapped
+		void Append(const std::vector<unsigned int>& sequence);
+
+		// Map a compiled dataset, interning its dictionary, false if it is invalid
+		bool Load(const std::string& filename, SymbolTable& symbols);
+		// Write the dataset in compiled form, false if the file cannot be written
+		bool Write(const std::string& filename, const SymbolTable& symbols) const;
+
+		unsigned int Sequences() const;
+		const unsigned int* Begin(unsigned int sequence) const;
+		const unsigned int* End(unsigned int sequence) const;
+
+		// Number of sequences per sequence length
+		std::map<unsigned int, unsigned int> Shape() const;
+		// Per symbol id below symbols the number of sequences containing it and
+		// its largest count within one sequence
+		void SymbolStatistics(unsigned int symbols, std::vector<unsigned int>& sequences, std::vector<unsigned int>& maxCounts) const;
+};
+#endif
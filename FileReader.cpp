@@ -42,6 +42,7 @@ bool FileReader::Line(std::vector<std::string>& lineData){
 
 	lineData = m_Line;
 	m_Line.clear();
+	return true;
 }
 
 void FileReader::SetShuffled(bool shuffled){
@@ -0,0 +1,94 @@
+#include "Metrics.h"
+
+#ifdef METRICS
+#include "Pattern.h"
+#include "PrefixCache.h"
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sys/resource.h>
+
+static const char* COUNTER_NAMES[Metrics::COUNTERS] = {
+	"sequences",
+	"tokens",
+	"c_memo_hits",
+	"c_stored_hits",
+	"c_computed",
+	"g_memo_hits",
+	"g_computed",
+	"dp_cells",
+	"p_exact",
+	"p_exact_blocks",
+	"permutations"
+};
+
+static std::mutex metricsMutex;
+static uint64_t collected[Metrics::COUNTERS] = {};
+static std::vector<std::pair<std::string, double>> phases;
+static const char* phase = nullptr;
+static std::chrono::steady_clock::time_point phaseStart;
+
+thread_local Metrics::ThreadCounters Metrics::m_Thread;
+
+Metrics::ThreadCounters::~ThreadCounters(){
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	for (unsigned int i = 0; i < COUNTERS; ++i){
+		collected[i] += values[i];
+	}
+}
+
+void Metrics::StartPhase(const char* name){
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	if (phase != nullptr){
+		phases.push_back(std::make_pair(phase, std::chrono::duration<double>(now - phaseStart).count()));
+	}
+	phase = name;
+	phaseStart = now;
+}
+
+bool Metrics::Write(const std::string& filename){
+	StartPhase(nullptr);
+	uint64_t totals[COUNTERS];
+	{
+		std::lock_guard<std::mutex> lock(metricsMutex);
+		for (unsigned int i = 0; i < COUNTERS; ++i){
+			totals[i] = collected[i] + m_Thread.values[i];
+		}
+	}
+	std::map<std::string, double> seconds;
+	for (auto const& p: phases){
+		seconds[p.first] += p.second;
+	}
+
+	std::ofstream out(filename);
+	out << "{" << std::endl << "\"counters\": {";
+	for (unsigned int i = 0; i < COUNTERS; ++i){
+		out << (i > 0 ? ", " : "") << "\"" << COUNTER_NAMES[i] << "\": " << totals[i];
+	}
+	out << "}," << std::endl << "\"phases\": {";
+	for (auto const& p: seconds){
+		out << (p.first != seconds.begin()->first ? ", " : "") << "\"" << p.first << "\": " << p.second;
+	}
+	out << "}," << std::endl;
+
+	double pass = seconds["pass"];
+	out << "\"rates\": {\"sequences_per_second\": " << (pass > 0 ? totals[SEQUENCES] / pass : 0)
+		<< ", \"tokens_per_second\": " << (pass > 0 ? totals[TOKENS] / pass : 0) << "}," << std::endl;
+
+	size_t cEntries, gEntries;
+	Pattern::CacheEntries(cEntries, gEntries);
+	unsigned long hits, misses, evictions;
+	PrefixCache::Counts(hits, misses, evictions);
+	out << "\"caches\": {\"c_memo_entries\": " << cEntries << ", \"g_memo_entries\": " << gEntries
+		<< ", \"prefix_hits\": " << hits << ", \"prefix_misses\": " << misses << ", \"prefix_evictions\": " << evictions << "}," << std::endl;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	out << "\"peak_rss_kb\": " << usage.ru_maxrss << std::endl << "}" << std::endl;
+	return (bool)out;
+}
+#endif
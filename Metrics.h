@@ -0,0 +1,54 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// Counters and phase timers for finding where a run spends its time, only
+// compiled in with -DMETRICS. Counters are kept per thread and added up when
+// a thread ends, so counting costs an increment of a thread local.
+#ifdef METRICS
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+class Metrics{
+	public:
+		enum Counter{
+			SEQUENCES,
+			TOKENS,
+			C_MEMO_HITS,
+			C_STORED_HITS,
+			C_COMPUTED,
+			G_MEMO_HITS,
+			G_COMPUTED,
+			DP_CELLS,
+			P_EXACT,
+			P_EXACT_BLOCKS,
+			PERMUTATIONS,
+			COUNTERS
+		};
+
+	private:
+		struct ThreadCounters{
+			uint64_t values[COUNTERS] = {};
+			~ThreadCounters();
+		};
+		static thread_local ThreadCounters m_Thread;
+
+	public:
+		static void Add(Counter counter, uint64_t n){
+			m_Thread.values[counter] += n;
+		}
+		// End the running phase and time the named one from now
+		static void StartPhase(const char* name);
+		// Write all counters, phase times, cache sizes and the peak resident
+		// set as JSON, from the thread that ran main
+		static bool Write(const std::string& filename);
+};
+
+#define METRIC_ADD(counter, n) Metrics::Add(Metrics::counter, n)
+#define METRIC_PHASE(name) Metrics::StartPhase(name)
+#else
+#define METRIC_ADD(counter, n)
+#define METRIC_PHASE(name)
+#endif
+#endif
@@ -0,0 +1,125 @@
+#include "PValue.h"
+
+#include <cmath>
+#include <limits>
+
+static const double LOG_SQRT_2PI = 0.91893853320467274178;
+
+const char* PValue::Name(Method method)
+{
+	switch (method){
+		case EXACT:
+			return "exact";
+		case NORMAL:
+			return "normal";
+		case SADDLEPOINT:
+			return "saddle-point";
+		default:
+			return "poisson";
+	}
+}
+
+double PValue::LogNormalTail(double z)
+{
+	// erfc stays within the double range up to z = 37, beyond that the
+	// asymptotic series of the Mills ratio is accurate to 1e-10
+	if (z < 37){
+		return log(0.5 * erfc(z / sqrt(2.0)));
+	}
+	double z2 = z * z;
+	return -z2 / 2 - LOG_SQRT_2PI - log(z) + log(1 - 1 / z2 + 3 / (z2 * z2) - 15 / (z2 * z2 * z2));
+}
+
+double PValue::LogPoissonTail(unsigned int s, double lambda)
+{
+	if (s == 0) return 0;
+	if (lambda <= 0) return -std::numeric_limits<double>::infinity();
+
+	// Terms decrease away from the mode, so sum from s outwards until they
+	// no longer matter
+	auto logTerm = [lambda](double k){
+		return k * log(lambda) - lambda - std::lgamma(k + 1);
+	};
+	if (s > lambda){
+		// Upper tail directly, relative to its first term
+		double first = logTerm(s);
+		double sum = 0;
+		double term = 1;
+		for (double k = s; term > 1e-17 * sum; ++k){
+			sum += term;
+			term *= lambda / (k + 1);
+		}
+		return first + log(sum);
+	}
+	// The tail is at least about a half, take the complement of the lower one
+	double lower = 0;
+	double term = exp(logTerm(s - 1));
+	for (double k = s - 1; k >= 0 && term > 1e-17 * lower; --k){
+		lower += term;
+		term *= k / lambda;
+	}
+	return log(std::max(0.0, 1 - lower));
+}
+
+bool PValue::LogSaddlePoint(const std::map<double, unsigned int>& blocks, unsigned int s, double& logP)
+{
+	double n = 0;
+	double mean = 0;
+	for (auto const& block: blocks){
+		n += block.second;
+		mean += block.second * block.first;
+	}
+	// Continuity corrected support, the saddle-point equation K'(theta) = x
+	// needs it strictly between 0 and n
+	double x = s - 0.5;
+	if (x <= 0 || x >= n) return false;
+
+	// Cumulant generating function and its derivatives at theta
+	auto cumulants = [&](double theta, double& K, double& K1, double& K2){
+		K = K1 = K2 = 0;
+		for (auto const& block: blocks){
+			double p = block.first;
+			double q = 1 - p;
+			double e = p * exp(theta);
+			double d = q + e;
+			K += block.second * log(d);
+			K1 += block.second * e / d;
+			K2 += block.second * q * e / (d * d);
+		}
+	};
+
+	// K' is increasing, Newton steps safeguarded by a bracket
+	double low = -700;
+	double high = 700;
+	double theta = 0;
+	double K, K1, K2;
+	for (unsigned int i = 0; i < 200; ++i){
+		cumulants(theta, K, K1, K2);
+		if (K1 < x) low = theta; else high = theta;
+		double next = theta - (K1 - x) / K2;
+		if (!(next > low && next < high)) next = (low + high) / 2;
+		if (std::abs(next - theta) < 1e-12) break;
+		theta = next;
+	}
+	cumulants(theta, K, K1, K2);
+	if (std::abs(theta) < 1e-4 || K2 <= 0 || std::abs(mean - x) < 1e-9) return false;
+
+	double w = (theta > 0 ? 1 : -1) * sqrt(std::max(0.0, 2 * (theta * x - K)));
+	double u = 2 * sinh(theta / 2) * sqrt(K2);
+	if (w == 0) return false;
+
+	// P = Phi(-w) + phi(w) (1/u - 1/w), written as phi(w) times the Mills
+	// ratio plus the correction so the upper tail stays in log space
+	double logPhi = -w * w / 2 - LOG_SQRT_2PI;
+	if (w > 0){
+		double mills = exp(LogNormalTail(w) - logPhi);
+		double factor = mills + 1 / u - 1 / w;
+		if (factor <= 0) return false;
+		logP = logPhi + log(factor);
+	} else {
+		double p = exp(LogNormalTail(w)) + exp(logPhi) * (1 / u - 1 / w);
+		if (p <= 0 || p > 1) return false;
+		logP = log(p);
+	}
+	return true;
+}
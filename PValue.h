@@ -0,0 +1,22 @@
+#ifndef PVALUE_H
+#define PVALUE_H
+
+#include <map>
+
+// Upper tails P(X >= s) of approximations to the support distribution, a
+// sum of Bernoulli variables given as blocks of (probability, count). All
+// are computed in log space so tiny p-values keep their -log.
+class PValue{
+	public:
+		enum Method { EXACT, NORMAL, SADDLEPOINT, POISSON };
+		static const char* Name(Method method);
+
+		// log P(Z >= z) for a standard normal Z
+		static double LogNormalTail(double z);
+		// log P(X >= s) for X Poisson distributed with mean lambda
+		static double LogPoissonTail(unsigned int s, double lambda);
+		// Lugannani-Rice saddle-point approximation with continuity correction,
+		// false where it breaks down, close to the mean or at the edges
+		static bool LogSaddlePoint(const std::map<double, unsigned int>& blocks, unsigned int s, double& logP);
+};
+#endif
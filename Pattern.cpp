@@ -1,5 +1,8 @@
 #include "Pattern.h"
 
+#include <cstring>
+#include <limits>
+
 BigInt Pattern::G(int b, int e)
 {
 	if (b < e){
@@ -11,6 +14,7 @@ BigInt Pattern::G(int b, int e)
 	BigInt f;
 	auto search = m_G.find(std::make_pair(b, e));
 	if (search == m_G.end()){
+		METRIC_ADD(G_COMPUTED, 1);
 		for(int i = b + 1; i <= b + e; ++i){
 			f *= i;
 		}
@@ -20,46 +24,71 @@ BigInt Pattern::G(int b, int e)
 		}
 		m_G[std::make_pair(b, e)] = f;
 	} else {
+		METRIC_ADD(G_MEMO_HITS, 1);
 		f = search->second;
 	}
 
 	return f;
 }
 
+double Pattern::LogG(int b, int e)
+{
+	// log((b+e)! / (b! e!)) from a table of log-factorials
+	if (m_LogFactorial.size() <= (unsigned int) (b + e)){
+		for (unsigned int i = m_LogFactorial.size(); i <= (unsigned int) (b + e); ++i){
+			m_LogFactorial.push_back(std::lgamma(i + 1.0));
+		}
+	}
+	return m_LogFactorial[b + e] - m_LogFactorial[b] - m_LogFactorial[e];
+}
+
 double Pattern::C(std::vector<unsigned int> X)
 {
 	if (X.size() == 1) return 1.0;
-	if (m_C.find(X) != m_C.end()) return m_C[X];
+	auto search = m_C.find(X);
+	if (search != m_C.end()){
+		METRIC_ADD(C_MEMO_HITS, 1);
+		return search->second;
+	}
+	double result;
+	if (m_StoredC != nullptr && m_StoredC->Find(X, result)){
+		METRIC_ADD(C_STORED_HITS, 1);
+		return result;
+	}
 
+	METRIC_ADD(C_COMPUTED, 1);
+	if (!m_FixedKernels || !CFixedValue(X, result)){
+		result = CMethodValue(X, m_CMethod, &m_Prefixes);
+	}
+	m_C[X] = result;
+	return result;
+}
+
+double Pattern::CBigInt(std::vector<unsigned int> X, PrefixCache* prefixes)
+{
 	unsigned int edge_sum = 0;
 	for (unsigned int i: X){
 		edge_sum += i;
 	}
+	if (edge_sum == 0) return 0;
 
-	double* Ve = new double[edge_sum]();
-	double* Vo = new double[edge_sum]();
-	double* V;
-	double* temp;
-	Ve[0] = 1;
-	Vo[0] = 1;
+	std::vector<double> V(edge_sum);
+	std::vector<double> temp(edge_sum);
+	V[0] = 1;
 
+	// Continue from the state of the longest cached prefix of X
+	unsigned int first = std::max(1u, (prefixes == nullptr ? 0 : prefixes->Resume(X, V)));
 	unsigned int l = 0;
-	for (unsigned int n = 1; n < X.size(); ++n){
+	for (unsigned int n = 1; n < first; ++n){
 		l += X[n - 1];
-		BigInt norm_term = G(l, X[n]);
-
-		if (n % 2){
-			V = Vo;
-			temp = Ve;
-		} else {
-			V = Ve;
-			temp = Vo;
-		}
+	}
 
-		for (unsigned int j = 0; j < l; ++j){
-			temp[j] = 0;
-		}
+	for (unsigned int n = first; n < X.size(); ++n){
+		l += X[n - 1];
+		BigInt norm_term = G(l, X[n]);
 
+		METRIC_ADD(DP_CELLS, (uint64_t)X[n] * l * (l + 1) / 2);
+		std::fill(temp.begin(), temp.begin() + l + X[n], 0.0);
 		for (unsigned int j = 0; j < l; ++j){
 			for (unsigned int p = j + 1; p <= l; ++p){
 				for (unsigned int t = 0; t < X[n]; ++t){
@@ -71,40 +100,425 @@ double Pattern::C(std::vector<unsigned int> X)
 				}
 			}
 		}
+		V.swap(temp);
+		if (prefixes != nullptr && n + 1 < X.size()) prefixes->Store(X, n + 1, V);
 	}
 
 	double result = 0;
 	for (unsigned int i = 0; i < edge_sum; ++i){
-		result += temp[i];
+		result += V[i];
 	}
+	return result;
+}
 
-	delete [] Ve;
-	delete [] Vo;
+double Pattern::CLog(std::vector<unsigned int> X, PrefixCache* prefixes)
+{
+	unsigned int edge_sum = 0;
+	for (unsigned int i: X){
+		edge_sum += i;
+	}
+	if (edge_sum == 0) return 0;
 
-	m_C[X] = result;
+	// Same recursion as CBigInt, with each ratio of binomials taken in log space
+	std::vector<double> V(edge_sum);
+	std::vector<double> temp(edge_sum);
+	V[0] = 1;
+
+	unsigned int first = std::max(1u, (prefixes == nullptr ? 0 : prefixes->Resume(X, V)));
+	unsigned int l = 0;
+	for (unsigned int n = 1; n < first; ++n){
+		l += X[n - 1];
+	}
+
+	for (unsigned int n = first; n < X.size(); ++n){
+		l += X[n - 1];
+		double norm_term = LogG(l, X[n]);
+
+		METRIC_ADD(DP_CELLS, (uint64_t)X[n] * l * (l + 1) / 2);
+		std::fill(temp.begin(), temp.begin() + l + X[n], 0.0);
+		for (unsigned int j = 0; j < l; ++j){
+			if (V[j] == 0) continue;
+			for (unsigned int p = j + 1; p <= l; ++p){
+				for (unsigned int t = 0; t < X[n]; ++t){
+					temp[p + t] += V[j] * exp(LogG(j, t) + LogG(l - p, X[n] - t - 1) - norm_term);
+				}
+			}
+		}
+		V.swap(temp);
+		if (prefixes != nullptr && n + 1 < X.size()) prefixes->Store(X, n + 1, V);
+	}
+
+	double result = 0;
+	for (unsigned int i = 0; i < edge_sum; ++i){
+		result += V[i];
+	}
+	return result;
+}
+
+double Pattern::CPrefix(std::vector<unsigned int> X, PrefixCache* prefixes)
+{
+	unsigned int edge_sum = 0;
+	for (unsigned int i: X){
+		edge_sum += i;
+	}
+	if (edge_sum == 0) return 0;
+	// Binomials up to 2^edge_sum have to fit in a double
+	if (edge_sum >= 1000) return CLog(X, prefixes);
+
+	std::vector<double> V(edge_sum);
+	std::vector<double> temp(edge_sum);
+	std::vector<double> binomials;
+	std::vector<double> A;
+	std::vector<double> W;
+	V[0] = 1;
+
+	unsigned int first = std::max(1u, (prefixes == nullptr ? 0 : prefixes->Resume(X, V)));
+	unsigned int l = 0;
+	for (unsigned int n = 1; n < first; ++n){
+		l += X[n - 1];
+	}
+
+	for (unsigned int n = first; n < X.size(); ++n){
+		l += X[n - 1];
+		const unsigned int x = X[n];
+
+		// Row t holds G(a, t) for a = 0..l
+		const unsigned int row = l + 1;
+		binomials.assign((x + 1) * row, 1.0);
+		for (unsigned int t = 1; t <= x; ++t){
+			double* current = binomials.data() + t * row;
+			const double* previous = current - row;
+			for (unsigned int a = 1; a <= l; ++a){
+				current[a] = current[a - 1] + previous[a];
+			}
+		}
+		const double norm_term = binomials[x * row + l];
+
+		// temp[p+t] = sum over j < p of V[j]·G(j,t)·G(l-p, x-t-1) / G(l, x),
+		// the sum over j is a prefix sum A[p] shared by all p
+		METRIC_ADD(DP_CELLS, (uint64_t)x * l);
+		std::fill(temp.begin(), temp.begin() + l + x, 0.0);
+		A.resize(l + 1);
+		W.resize(l + 1);
+		for (unsigned int t = 0; t < x; ++t){
+			const double* start = binomials.data() + t * row;
+			const double* end = binomials.data() + (x - t - 1) * row;
+			A[0] = 0;
+			for (unsigned int p = 1; p <= l; ++p){
+				A[p] = A[p - 1] + V[p - 1] * start[p - 1];
+			}
+			for (unsigned int p = 1; p <= l; ++p){
+				W[p] = end[l - p];
+			}
+			double* out = temp.data() + t;
+			for (unsigned int p = 1; p <= l; ++p){
+				out[p] += A[p] * W[p] / norm_term;
+			}
+		}
+		V.swap(temp);
+		if (prefixes != nullptr && n + 1 < X.size()) prefixes->Store(X, n + 1, V);
+	}
+
+	double result = 0;
+	for (unsigned int i = 0; i < edge_sum; ++i){
+		result += V[i];
+	}
+	return result;
+}
+
+double Pattern::CMethodValue(std::vector<unsigned int> X, CMethod method, PrefixCache* prefixes)
+{
+	switch (method){
+		case C_LOG:
+			return CLog(X, prefixes);
+		case C_PREFIX:
+			return CPrefix(X, prefixes);
+		default:
+			return CBigInt(X, prefixes);
+	}
+}
+
+double Pattern::CompareC(const std::vector<unsigned int>& X, CMethod method, std::ostream& out)
+{
+	double exact = CBigInt(X, nullptr);
+	double approximation = CMethodValue(X, method, nullptr);
+	double error = std::abs(approximation - exact) / exact;
+	for (unsigned int x: X){
+		out << x << " ";
+	}
+	out << ": " << exact << " " << approximation << " " << error << std::endl;
+	return error;
+}
+
+double Pattern::ValidateC(const std::map<std::vector<unsigned int>, double>& vectors, CMethod method, std::ostream& out)
+{
+	double max_error = 0;
+	out << std::setprecision(17);
+	for (auto const& x: vectors){
+		if (x.first.size() < 2) continue;
+		max_error = std::max(max_error, CompareC(x.first, method, out));
+	}
+	return max_error;
+}
+
+double Pattern::ValidateC(unsigned int maxLength, unsigned int maxCount, CMethod method, std::ostream& out)
+{
+	// Compare both methods on every sorted count vector within the bounds
+	double max_error = 0;
+	out << std::setprecision(17);
+	for (unsigned int length = 2; length <= maxLength; ++length){
+		std::vector<unsigned int> X(length, 1);
+		while (true){
+			max_error = std::max(max_error, CompareC(X, method, out));
+
+			// Next non-decreasing vector
+			int i = length - 1;
+			while (i >= 0 && X[i] == maxCount) --i;
+			if (i < 0) break;
+			X[i]++;
+			for (unsigned int k = i + 1; k < length; ++k){
+				X[k] = X[i];
+			}
+		}
+	}
+	return max_error;
+}
+
+void Pattern::PrecomputeC(unsigned int maxLength, unsigned int maxCount)
+{
+	for (unsigned int length = 2; length <= maxLength; ++length){
+		std::vector<unsigned int> X(length, 1);
+		while (true){
+			C(X);
+
+			// Next non-decreasing vector
+			int i = length - 1;
+			while (i >= 0 && X[i] == maxCount) --i;
+			if (i < 0) break;
+			X[i]++;
+			for (unsigned int k = i + 1; k < length; ++k){
+				X[k] = X[i];
+			}
+		}
+	}
+}
+
+void Pattern::SetStoredC(const CCache* stored)
+{
+	m_StoredC = stored;
+}
+
+void Pattern::SetCMethod(CMethod method)
+{
+	m_CMethod = method;
+}
+
+bool Pattern::ParseCMethod(const char* name, CMethod& method)
+{
+	if (std::strcmp(name, "bigint") == 0){
+		method = C_BIGINT;
+	} else if (std::strcmp(name, "log") == 0){
+		method = C_LOG;
+	} else if (std::strcmp(name, "prefix") == 0){
+		method = C_PREFIX;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+uint32_t Pattern::CMethodId()
+{
+	// Kernel values differ from the method's in the last bits, so caches
+	// and checkpoints only mix values computed the same way
+	return m_CMethod | (m_FixedKernels ? 0x100 : 0);
+}
+
+void Pattern::SetDeferred(bool enabled)
+{
+	m_Deferred = enabled;
+}
+
+bool Pattern::Deferred()
+{
+	return m_Deferred;
+}
+
+const std::map<std::vector<unsigned int>, unsigned int>& Pattern::DeferredVectors() const
+{
+	return m_Vectors;
+}
+
+void Pattern::FillDeferred(const std::map<std::vector<unsigned int>, double>& probabilities, const StatisticsPlan& plan)
+{
+	for (auto const& x: m_Vectors){
+		double occurs_prob = probabilities.at(x.first);
+		m_ExpectedValue += x.second * occurs_prob;
+		m_Variance += x.second * (occurs_prob * (1.0 - occurs_prob));
+		if (occurs_prob > 0){
+			if (plan.distribution) m_P[occurs_prob] += x.second;
+			m_NonZeroSequences += x.second;
+		}
+	}
+	m_Vectors.clear();
+}
+
+void Pattern::SetPTolerance(double tolerance)
+{
+	m_PTolerance = tolerance;
+}
+
+double Pattern::PTolerance()
+{
+	return m_PTolerance;
+}
+
+void Pattern::SetFixedKernels(bool enabled)
+{
+	m_FixedKernels = enabled;
+}
+
+bool Pattern::FixedKernels()
+{
+	return m_FixedKernels;
+}
+
+Pattern::Cache Pattern::TakeCache()
+{
+	Cache cache;
+	cache.G.swap(m_G);
+	cache.C.swap(m_C);
+	return cache;
+}
+
+void Pattern::MergeCache(Cache& cache)
+{
+	m_G.merge(cache.G);
+	m_C.merge(cache.C);
+}
+
+void Pattern::CacheEntries(size_t& c, size_t& g)
+{
+	c = m_C.size();
+	g = m_G.size();
+}
+
+
+const double* Pattern::Binomials()
+{
+	// Pascal's triangle, entry [n * (C_FIXED_CAPACITY + 1) + k] is n choose k
+	static const std::vector<double> binomials = [](){
+		const unsigned int size = C_FIXED_CAPACITY + 1;
+		std::vector<double> table(size * size, 0);
+		for (unsigned int n = 0; n < size; ++n){
+			table[n * size] = 1;
+			for (unsigned int k = 1; k <= n; ++k){
+				table[n * size + k] = table[(n - 1) * size + k - 1] + table[(n - 1) * size + k];
+			}
+		}
+		return table;
+	}();
+	return binomials.data();
+}
+
+template<>
+double Pattern::CFixed<2>(const std::array<unsigned int, 2>& X)
+{
+	// The pattern is absent only when all X[1] later symbols come first
+	if (X[0] + X[1] <= C_FIXED_CAPACITY){
+		return 1.0 - 1.0 / Binomials()[(X[0] + X[1]) * (C_FIXED_CAPACITY + 1) + X[0]];
+	}
+	return 1.0 - exp(-LogG(X[0], X[1]));
+}
+
+template<unsigned int N>
+double Pattern::CFixed(const std::array<unsigned int, N>& X)
+{
+	const unsigned int size = C_FIXED_CAPACITY + 1;
+	const double* binomial = Binomials();
+	double Ve[C_FIXED_CAPACITY] = {1};
+	double Vo[C_FIXED_CAPACITY] = {0};
+	double* V = Ve;
+	double* temp = Vo;
+
+	// Same recursion as CBigInt, G(b, e) is (b + e) choose e
+	unsigned int l = 0;
+	for (unsigned int n = 1; n < N; ++n){
+		l += X[n - 1];
+		const unsigned int x = X[n];
+		const double norm_term = binomial[(l + x) * size + x];
+
+		METRIC_ADD(DP_CELLS, (uint64_t)x * l * (l + 1) / 2);
+		std::fill(temp, temp + l + x, 0.0);
+		for (unsigned int j = 0; j < l; ++j){
+			if (V[j] == 0) continue;
+			for (unsigned int p = j + 1; p <= l; ++p){
+				for (unsigned int t = 0; t < x; ++t){
+					temp[p + t] += V[j] * binomial[(j + t) * size + t] * binomial[(l - p + x - t - 1) * size + x - t - 1] / norm_term;
+				}
+			}
+		}
+		std::swap(V, temp);
+	}
+
+	double result = 0;
+	for (unsigned int i = 0; i < l + X[N - 1]; ++i){
+		result += V[i];
+	}
 	return result;
 }
 
+bool Pattern::CFixedValue(const std::vector<unsigned int>& X, double& result)
+{
+	unsigned int edge_sum = 0;
+	for (unsigned int x: X){
+		edge_sum += x;
+	}
+	switch (X.size()){
+		case 2:
+			result = CFixed<2>({X[0], X[1]});
+			return true;
+		case 3:
+			if (edge_sum > C_FIXED_CAPACITY) return false;
+			result = CFixed<3>({X[0], X[1], X[2]});
+			return true;
+		case 4:
+			if (edge_sum > C_FIXED_CAPACITY) return false;
+			result = CFixed<4>({X[0], X[1], X[2], X[3]});
+			return true;
+	}
+	return false;
+}
+
 double Pattern::OccursProbability()
 {
 	std::vector<unsigned int> X;
-	for (auto const& e: m_SymbolCounts){
-		if (e.second == 0) return 0;
-		X.push_back(e.second);
+	for (unsigned int count: m_SymbolCounts){
+		if (count == 0) return 0;
+		X.push_back(count);
 	}
 	std::sort(X.begin(), X.end());
 	return C(X);
 }
 
-Pattern::Pattern(std::vector<std::string> patternSymbols, unsigned int verbosity):
-	Pattern{patternSymbols}
+double Pattern::OccursProbability(const std::vector<unsigned int>& X)
+{
+	return C(X);
+}
+
+Pattern::Pattern(std::vector<std::string> patternSymbols, SymbolTable& symbols, unsigned int verbosity):
+	Pattern{patternSymbols, symbols}
 {
 	m_Verbose = verbosity;
 }
 
-Pattern::Pattern(std::vector<std::string> patternSymbols):
+Pattern::Pattern(std::vector<std::string> patternSymbols, SymbolTable& symbols):
+	m_NonZeroSequences(0),
 	m_ExpectedValue(0),
 	m_Variance(0),
+	m_RealValue(0),
+	m_Sampled(false),
+	m_SampleError(0),
 	m_Verbose(0),
 	m_ActiveSymbol(0),
 	m_Symbols{patternSymbols}
@@ -122,11 +536,22 @@ Pattern::Pattern(std::vector<std::string> patternSymbols):
 		throw std::domain_error(error_msg.str());
 	}
 
-	// Initialize counters
+	// Initialize symbol ids and counters
 	for (auto const& e: m_Symbols){
-		m_SymbolCounts[e] = 0;
-		m_TotalSymbolCounts[e] = 0;
+		m_SymbolIds.push_back(symbols.Intern(e));
 	}
+	m_SymbolCounts.assign(m_Symbols.size(), 0);
+	m_TotalSymbolCounts.assign(m_Symbols.size(), 0);
+}
+
+const std::vector<std::string>& Pattern::Symbols() const
+{
+	return m_Symbols;
+}
+
+const std::vector<unsigned int>& Pattern::SymbolIds() const
+{
+	return m_SymbolIds;
 }
 
 double Pattern::StandardDeviation() const
@@ -150,23 +575,217 @@ double Pattern::PNormal() const
 	return erfc(z / sqrt(2.0)) / 2.0;
 }
 
-double Pattern::PExact() const
+std::vector<double> Pattern::SupportDistribution(unsigned int limit) const
 {
-	double* Q = new double[m_P.size()+1]();
+	// Convolve one binomial block per distinct probability. Mass reaching the
+	// limit is absorbed in the last entry, so a block costs O(limit * min(m, limit)).
+	METRIC_ADD(P_EXACT, 1);
+	METRIC_ADD(P_EXACT_BLOCKS, m_P.size());
+	std::vector<double> Q(limit+1);
+	std::vector<double> next(limit+1);
+	std::vector<double> pmf;
+	std::vector<double> tail;
 	Q[0] = 1;
-	for (const double p: m_P){
-		for (int i = m_P.size(); i >= 1; --i){
-			Q[i] = Q[i]*(1-p) + Q[i-1]*p;
+	for (auto const& block: m_P){
+		const double p = block.first;
+		const unsigned int m = block.second;
+
+		// Binomial(m, p) probabilities and upper tails, the tails summed from
+		// the top so that tiny ones keep their precision
+		pmf.assign(m+1, 0);
+		if (p >= 1){
+			pmf[m] = 1;
+		} else {
+			for (unsigned int k = 0; k <= m; ++k){
+				pmf[k] = exp(std::lgamma(m + 1.0) - std::lgamma(k + 1.0) - std::lgamma(m - k + 1.0)
+					+ k * log(p) + (m - k) * log1p(-p));
+			}
+		}
+		tail.assign(m+2, 0);
+		for (int k = m; k >= 0; --k){
+			tail[k] = tail[k+1] + pmf[k];
+		}
+
+		std::fill(next.begin(), next.end(), 0.0);
+		next[limit] = Q[limit];
+		for (unsigned int i = 0; i < limit; ++i){
+			if (Q[i] == 0) continue;
+			unsigned int reach = std::min(m, limit - i - 1);
+			for (unsigned int k = 0; k <= reach; ++k){
+				next[i+k] += Q[i] * pmf[k];
+			}
+			if (limit - i <= m){
+				next[limit] += Q[i] * tail[limit - i];
+			}
+		}
+		Q.swap(next);
+	}
+	return Q;
+}
+
+double Pattern::PExact() const
+{
+	if (Support() > NonZeroSequences()) return 0;
+	// Blocks scaled up from a sample would make the convolution as costly as
+	// over the whole data
+	if (m_Sampled) return exp(LogPSampled());
+	return SupportDistribution(Support()).back();
+}
+
+std::vector<double> Pattern::PExactTail() const
+{
+	std::vector<double> tail = SupportDistribution(NonZeroSequences());
+	for (int i = tail.size() - 2; i >= 0; --i){
+		tail[i] += tail[i+1];
+	}
+	return tail;
+}
+
+double Pattern::LogPAuto(PValue::Method& method) const
+{
+	// Work of the exact convolution up to the support, below the budget it is
+	// cheaper than checking the approximations
+	const double EXACT_BUDGET = 1e6;
+	method = PValue::EXACT;
+	unsigned int s = Support();
+	if (s == 0) return 0;
+	if (s > NonZeroSequences()) return -std::numeric_limits<double>::infinity();
+
+	double cost = 0;
+	double mean = 0;
+	double variance = 0;
+	double squares = 0;
+	double third = 0;
+	for (auto const& block: m_P){
+		double p = block.first;
+		double q = 1 - p;
+		cost += (double) s * std::min(block.second, s);
+		mean += block.second * p;
+		variance += block.second * p * q;
+		squares += block.second * p * p;
+		third += block.second * p * q * (p * p + q * q);
+	}
+
+	// Berry-Esseen bound for independent, non-identical summands (constant
+	// by Shevtsova) and the Barbour-Hall refinement of Le Cam's bound
+	double normalError = (variance > 0 ? 0.56 * third / pow(variance, 1.5) : 1);
+	double poissonError = (mean > 0 ? (1 - exp(-mean)) / mean * squares : 1);
+	double tolerance = m_PTolerance;
+
+	double logP;
+	double bound = 0;
+	double saddle;
+	if (cost <= EXACT_BUDGET || std::min(normalError, poissonError) > tolerance){
+		double p = PExact();
+		logP = log(p);
+		if (p < std::numeric_limits<double>::min()){
+			// Below the double range every approximation is within the
+			// tolerance, the saddle point keeps its relative accuracy there
+			if (PValue::LogSaddlePoint(m_P, s, saddle)){
+				method = PValue::SADDLEPOINT;
+				logP = saddle;
+			} else if (poissonError <= normalError){
+				method = PValue::POISSON;
+				logP = PValue::LogPoissonTail(s, mean);
+			} else {
+				method = PValue::NORMAL;
+				logP = PValue::LogNormalTail((s - 0.5 - mean) / sqrt(variance));
+			}
+		}
+	} else if (poissonError <= normalError){
+		method = PValue::POISSON;
+		bound = poissonError;
+		logP = PValue::LogPoissonTail(s, mean);
+	} else {
+		// The saddle-point value is kept while it stays within the tolerance
+		// left by the normal bound, otherwise the nearest value that does
+		method = PValue::NORMAL;
+		bound = normalError;
+		logP = PValue::LogNormalTail((s - 0.5 - mean) / sqrt(variance));
+		if (PValue::LogSaddlePoint(m_P, s, saddle)){
+			double slack = tolerance - normalError;
+			double normal = exp(logP);
+			double refined = exp(saddle);
+			if (std::abs(refined - normal) <= slack){
+				method = PValue::SADDLEPOINT;
+				logP = saddle;
+			} else {
+				logP = log(refined < normal ? normal - slack : normal + slack);
+			}
 		}
-		Q[0] = Q[0]*(1-p);
 	}
-	double p = 0;
-	for (int i = Support(); i <= m_P.size(); ++i){
-		p += Q[i];
+
+	if (m_Verbose >= 2){
+		std::cout << "|p-auto| " << ToString() << PValue::Name(method) << " bound=" << bound << " log(p)=" << logP << std::endl;
 	}
+	return std::min(logP, 0.0);
+}
+
+double Pattern::LogPAuto() const
+{
+	PValue::Method method;
+	return LogPAuto(method);
+}
 
-	delete [] Q;
-	return p;
+double Pattern::PAuto() const
+{
+	return exp(LogPAuto());
+}
+
+double Pattern::LogPLowerBound() const
+{
+	unsigned int s = Support();
+	if (s == 0) return 0;
+	if (s > NonZeroSequences()) return -std::numeric_limits<double>::infinity();
+
+	double mean = 0;
+	double variance = 0;
+	for (auto const& block: m_P){
+		mean += block.second * block.first;
+		variance += block.second * block.first * (1 - block.first);
+	}
+	// The median of a sum of Bernoulli variables is the floor or the ceiling
+	// of the mean
+	if (s <= floor(mean)) return log(0.5);
+
+	// Cantelli's inequality for P(X <= s - 1) below the mean
+	double bound = -std::numeric_limits<double>::infinity();
+	double t = mean - s + 1;
+	if (t > 0) bound = log(t * t / (variance + t * t));
+
+	// At least the chance that the s most likely sequences all contain it
+	double product = 0;
+	unsigned int remaining = s;
+	for (auto it = m_P.rbegin(); it != m_P.rend() && remaining > 0; ++it){
+		unsigned int n = std::min(it->second, remaining);
+		product += n * log(it->first);
+		remaining -= n;
+	}
+	return std::max(bound, product);
+}
+
+double Pattern::LogPSampled() const
+{
+	unsigned int s = Support();
+	if (s == 0) return 0;
+	if (s > NonZeroSequences()) return -std::numeric_limits<double>::infinity();
+
+	double logP;
+	if (PValue::LogSaddlePoint(m_P, s, logP)) return std::min(logP, 0.0);
+
+	// Every sequence with a non-zero probability has to contain it, otherwise
+	// the support is close to the mean where the normal tail is accurate
+	double mean = 0;
+	double variance = 0;
+	double product = 0;
+	for (auto const& block: m_P){
+		mean += block.second * block.first;
+		variance += block.second * block.first * (1 - block.first);
+		product += block.second * log(block.first);
+	}
+	if (s == NonZeroSequences()) return product;
+	if (variance <= 0) return (s <= mean ? 0 : -std::numeric_limits<double>::infinity());
+	return std::min(PValue::LogNormalTail((s - 0.5 - mean) / sqrt(variance)), 0.0);
 }
 
 double Pattern::PPoisson() const
@@ -196,30 +815,47 @@ double Pattern::PPoisson() const
 
 unsigned int Pattern::NonZeroSequences() const
 {
-	return m_P.size();
+	return m_NonZeroSequences;
 }
 
-void Pattern::Process(bool onlyCount)
+void Pattern::Process(const StatisticsPlan& plan)
 {
-	if (onlyCount == false){
-		Process();
-	} else {
-		int occuring = (m_ActiveSymbol == m_Symbols.size());
+	int occuring = (m_ActiveSymbol == m_Symbols.size());
+	m_RealValue += occuring;
+
+	if (m_Deferred && plan.Probabilities()){
+		// Sequences missing a symbol have probability 0 and add nothing
+		static thread_local std::vector<unsigned int> X;
+		X.clear();
+		for (unsigned int count: m_SymbolCounts){
+			if (count == 0) return;
+			X.push_back(count);
+		}
+		std::sort(X.begin(), X.end());
+		auto found = m_Vectors.find(X);
+		if (found == m_Vectors.end()){
+			m_Vectors.emplace(X, 1);
+		} else {
+			found->second++;
+		}
+		return;
+	}
+
+	if (!plan.Probabilities()){
+		if (plan.nonZero && std::find(m_SymbolCounts.begin(), m_SymbolCounts.end(), 0) == m_SymbolCounts.end()){
+			m_NonZeroSequences++;
+		}
 		if (m_Verbose >= 2){
 			std::cout
 				<< ToString()
 				<< " occuring=" << occuring
 				<< std::endl;
 		}
-		m_RealValue += occuring;
+		return;
 	}
-}
 
-void Pattern::Process()
-{
 	double occurs_prob = OccursProbability();
 	double var = occurs_prob * (1.0 - occurs_prob);
-	int occuring = (m_ActiveSymbol == m_Symbols.size());
 
 	if (m_Verbose >= 2){
 		std::cout
@@ -231,30 +867,25 @@ void Pattern::Process()
 	}
 
 	m_ExpectedValue += occurs_prob;
-	m_RealValue += occuring;
 	m_Variance += var;
 	if (occurs_prob > 0){
-		m_P.push_back(occurs_prob);
+		if (plan.distribution) m_P[occurs_prob]++;
+		m_NonZeroSequences++;
 	}
 }
 
-bool Pattern::SymbolSeen(std::string symbol)
+void Pattern::Process()
 {
-	return SymbolSeen(symbol, false);
+	Process(StatisticsPlan());
 }
 
-bool Pattern::SymbolSeen(std::string symbol, bool onlyCount)
+void Pattern::SequenceSeen(unsigned int matched, const std::vector<unsigned int>& symbolCounts, const StatisticsPlan& plan)
 {
-	if (std::find(m_Symbols.begin(), m_Symbols.end(), symbol) != m_Symbols.end()){
-		if (m_ActiveSymbol < m_Symbols.size() && m_Symbols.at(m_ActiveSymbol) == symbol){
-			m_ActiveSymbol++;
-		}
-		m_SymbolCounts[symbol] += 1;
-		if (!onlyCount)
-			m_TotalSymbolCounts[symbol] += 1;
-		return true;
-	} else {
-		return false;
+	m_ActiveSymbol = matched;
+	for (unsigned int i = 0; i < m_SymbolIds.size(); ++i){
+		m_SymbolCounts[i] = symbolCounts[m_SymbolIds[i]];
+		if (plan.symbolTotals)
+			m_TotalSymbolCounts[i] += m_SymbolCounts[i];
 	}
 }
 
@@ -267,68 +898,174 @@ void Pattern::Reset()
 void Pattern::Clear()
 {
 	m_ActiveSymbol = 0;
-	for (auto const& e: m_Symbols){
-		m_SymbolCounts[e] = 0;
-	}
+	std::fill(m_SymbolCounts.begin(), m_SymbolCounts.end(), 0);
 }
 
-std::string Pattern::ToString() const
+void Pattern::Merge(const Pattern& other)
 {
-	std::stringstream result;
-	for (auto i: m_Symbols){
-		result << i << " ";
+	for (auto const& x: other.m_Vectors){
+		m_Vectors[x.first] += x.second;
+	}
+	m_ExpectedValue += other.m_ExpectedValue;
+	m_Variance += other.m_Variance;
+	for (auto const& block: other.m_P){
+		m_P[block.first] += block.second;
+	}
+	m_NonZeroSequences += other.m_NonZeroSequences;
+	m_RealValue += other.m_RealValue;
+	for (unsigned int i = 0; i < m_TotalSymbolCounts.size(); ++i){
+		m_TotalSymbolCounts[i] += other.m_TotalSymbolCounts[i];
 	}
-	return result.str();
 }
 
-#ifdef SIGSPAN
-double* Pattern::Sigspan(double* probabilities, unsigned int pattern_length, unsigned int sequence_length) const{
-	double* Qx_ = new double[sequence_length]();
-	double* Qx = new double[sequence_length]();
+void Pattern::Scale(uint64_t population, unsigned int sampled)
+{
+	if (sampled == 0) return;
+	double n = sampled;
+	double factor = population / n;
+	// Scaled counts are kept within their 32 bits
+	auto scaled = [factor](double count){
+		return (unsigned int) std::min((double) std::lround(count * factor), 4294967295.0);
+	};
 
-	for (unsigned int i = 0; i < sequence_length; ++i){
-		Qx_[i] = probabilities[0] * pow(1-probabilities[0], i);
+	// Sample deviations of the per sequence support and occurrence
+	// probability, the sum of squared probabilities is E - Var. Their
+	// covariance is unknown, so the deviation of the difference is bounded
+	// by the sum.
+	double deviation = 0;
+	if (sampled > 1){
+		double support = m_RealValue;
+		double squares = m_ExpectedValue - m_Variance;
+		double supportVariance = support * (n - support) / (n * (n - 1));
+		double probabilityVariance = std::max(0.0, (squares - m_ExpectedValue * m_ExpectedValue / n) / (n - 1));
+		deviation = sqrt(supportVariance) + sqrt(probabilityVariance);
 	}
+	m_SampleError = population * sqrt(std::max(0.0, 1 - n / population) / n) * deviation;
+	m_Sampled = true;
 
-	for (unsigned int k = 2; k <= pattern_length; ++k){
-		for (unsigned int i = 0; i < sequence_length; ++i){
-			Qx[i] = 0;
-		}
-		for (unsigned int i = k; i <= sequence_length; ++i){
-			for (unsigned int j = k - 1; j <= i - 1; ++j){
-				Qx[i-1] += Qx_[j-1] * probabilities[k - 1] * pow(1-probabilities[k-1], i-j-1);
-			}
+	m_RealValue = scaled(m_RealValue);
+	m_ExpectedValue *= factor;
+	m_Variance *= factor;
+	for (auto& count: m_TotalSymbolCounts){
+		count = scaled(count);
+	}
+	m_NonZeroSequences = scaled(m_NonZeroSequences);
+	if (!m_P.empty()){
+		// Keep the blocks consistent with the number of non-zero sequences
+		uint64_t nonZero = 0;
+		for (auto& block: m_P){
+			block.second = std::max(1u, scaled(block.second));
+			nonZero += block.second;
 		}
-		double* tmp = Qx_;
-		Qx_ = Qx;
-		Qx = tmp;
+		m_NonZeroSequences = std::min(nonZero, (uint64_t) 4294967295u);
 	}
-	delete [] Qx;
+}
 
-	for (unsigned int i = 1; i < sequence_length; ++i){
-		Qx_[i] += Qx_[i-1];
-	}
+bool Pattern::Sampled() const
+{
+	return m_Sampled;
+}
 
-	return Qx_;
+double Pattern::SampleError() const
+{
+	return m_SampleError;
 }
 
+std::pair<Pattern, Pattern> Pattern::SupportInterval() const
+{
+	// Supports beyond the sequences with non-zero probability are impossible
+	const double z = 1.959963984540054;
+	std::pair<Pattern, Pattern> interval(*this, *this);
+	double margin = z * m_SampleError;
+	interval.first.m_RealValue = std::max(0.0, std::floor(m_RealValue - margin));
+	interval.second.m_RealValue = std::min((double) m_NonZeroSequences, std::ceil(m_RealValue + margin));
+	interval.first.m_Verbose = interval.second.m_Verbose = 0;
+	return interval;
+}
 
-double Pattern::ExpectedValueSigspan(std::map<unsigned int, unsigned int> dataset_shape) const
+void Pattern::ShareStatistics(const Pattern& group)
 {
-	unsigned int max_sequence_length = 0;
-	unsigned int dataset_size = 0;
-	for (auto const& x: dataset_shape){
-		max_sequence_length = std::max(x.first, max_sequence_length);
-		dataset_size += x.first * x.second;
+	m_ExpectedValue = group.m_ExpectedValue;
+	m_Variance = group.m_Variance;
+	m_P = group.m_P;
+	m_NonZeroSequences = group.m_NonZeroSequences;
+	for (unsigned int i = 0; i < m_SymbolIds.size(); ++i){
+		unsigned int position = std::find(group.m_SymbolIds.begin(), group.m_SymbolIds.end(), m_SymbolIds[i]) - group.m_SymbolIds.begin();
+		m_TotalSymbolCounts[i] = group.m_TotalSymbolCounts[position];
+	}
+}
+
+void Pattern::WriteState(std::ostream& out) const
+{
+	out.write(reinterpret_cast<const char*>(&m_RealValue), sizeof(m_RealValue));
+	out.write(reinterpret_cast<const char*>(&m_NonZeroSequences), sizeof(m_NonZeroSequences));
+	out.write(reinterpret_cast<const char*>(&m_ExpectedValue), sizeof(m_ExpectedValue));
+	out.write(reinterpret_cast<const char*>(&m_Variance), sizeof(m_Variance));
+	out.write(reinterpret_cast<const char*>(m_TotalSymbolCounts.data()), m_TotalSymbolCounts.size() * sizeof(unsigned int));
+	uint64_t blocks = m_P.size();
+	out.write(reinterpret_cast<const char*>(&blocks), sizeof(blocks));
+	for (auto const& block: m_P){
+		out.write(reinterpret_cast<const char*>(&block.first), sizeof(block.first));
+		out.write(reinterpret_cast<const char*>(&block.second), sizeof(block.second));
+	}
+}
+
+bool Pattern::ReadState(std::istream& in)
+{
+	in.read(reinterpret_cast<char*>(&m_RealValue), sizeof(m_RealValue));
+	in.read(reinterpret_cast<char*>(&m_NonZeroSequences), sizeof(m_NonZeroSequences));
+	in.read(reinterpret_cast<char*>(&m_ExpectedValue), sizeof(m_ExpectedValue));
+	in.read(reinterpret_cast<char*>(&m_Variance), sizeof(m_Variance));
+	in.read(reinterpret_cast<char*>(m_TotalSymbolCounts.data()), m_TotalSymbolCounts.size() * sizeof(unsigned int));
+	uint64_t blocks = 0;
+	in.read(reinterpret_cast<char*>(&blocks), sizeof(blocks));
+	m_P.clear();
+	for (uint64_t i = 0; i < blocks && in; ++i){
+		double p;
+		unsigned int sequences;
+		in.read(reinterpret_cast<char*>(&p), sizeof(p));
+		in.read(reinterpret_cast<char*>(&sequences), sizeof(sequences));
+		m_P[p] = sequences;
 	}
+	return (bool)in;
+}
 
-	double* probabilities = new double[m_Symbols.size()]();
+std::string Pattern::ToString() const
+{
+	std::stringstream result;
+	for (auto i: m_Symbols){
+		result << i << " ";
+	}
+	return result.str();
+}
 
+#ifdef SIGSPAN
+std::vector<double> Pattern::SigspanProbabilities(unsigned int dataset_size) const
+{
+	std::vector<double> probabilities(m_Symbols.size());
 	for (unsigned int i = 0; i < m_Symbols.size(); ++i){
-		probabilities[i] = (double) m_TotalSymbolCounts.at(m_Symbols[i]) / dataset_size;
+		probabilities[i] = (double) m_TotalSymbolCounts[i] / dataset_size;
+	}
+	return probabilities;
+}
+
+void Pattern::SetExpectedValueSigspan(double expected)
+{
+	m_SigspanExpected = expected;
+	m_SigspanTotals = m_TotalSymbolCounts;
+}
+
+double Pattern::ExpectedValueSigspan(std::map<unsigned int, unsigned int> dataset_shape) const
+{
+	// The trace needs the intermediate values, so it always recomputes
+	if (m_Verbose < 2 && m_SigspanTotals == m_TotalSymbolCounts){
+		return m_SigspanExpected;
 	}
 
-	double* result = Sigspan(probabilities, m_Symbols.size(), max_sequence_length);
+	SigspanEngine engine(dataset_shape);
+	unsigned int max_sequence_length = engine.Length();
+	std::vector<double> probabilities = SigspanProbabilities(engine.DatasetSize());
+	std::vector<double> result = engine.Occurrence(probabilities);
 
 	if (m_Verbose >= 2){
 		// Output item probabilities
@@ -358,17 +1095,7 @@ double Pattern::ExpectedValueSigspan(std::map<unsigned int, unsigned int> datase
 		std::cout << std::endl;
 	}
 
-	double expected_support = 0;
-	for (unsigned int i = m_Symbols.size(); i <= max_sequence_length; ++i){
-		if (dataset_shape.find(i) != dataset_shape.end()){
-			expected_support += dataset_shape.at(i) * result[i-1];
-		}
-	}
-
-	delete [] probabilities;
-	delete [] result;
-
-	return expected_support;
+	return engine.ExpectedValue(result, m_Symbols.size());
 }
 
 double Pattern::PSigspan(std::map<unsigned int, unsigned int> dataset_shape) const
@@ -383,5 +1110,12 @@ double Pattern::PSigspan(std::map<unsigned int, unsigned int> dataset_shape) con
 #endif
 
 // Memoization variables
-std::map<std::pair<int, int>, BigInt> Pattern::m_G;
-std::map<std::vector<unsigned int>, double> Pattern::m_C;
+thread_local std::map<std::pair<int, int>, BigInt> Pattern::m_G;
+thread_local std::vector<double> Pattern::m_LogFactorial;
+thread_local std::map<std::vector<unsigned int>, double> Pattern::m_C;
+const CCache* Pattern::m_StoredC = nullptr;
+thread_local PrefixCache Pattern::m_Prefixes;
+Pattern::CMethod Pattern::m_CMethod = Pattern::C_BIGINT;
+bool Pattern::m_FixedKernels = true;
+bool Pattern::m_Deferred = false;
+double Pattern::m_PTolerance = 0;
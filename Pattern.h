@@ -2,8 +2,18 @@
 #define PATTERN_H
 
 #include "BigInt.h"
+#include "CCache.h"
+#include "Metrics.h"
+#include "PrefixCache.h"
+#include "PValue.h"
+#include "SigspanEngine.h"
+#include "StatisticsPlan.h"
+#include "SymbolTable.h"
 
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <sstream>
@@ -13,40 +23,99 @@
 
 class Pattern
 {
+	public:
+		// Method used to compute the permutation probability
+		enum CMethod { C_BIGINT, C_LOG, C_PREFIX };
+
+		// Memoized values of G and C
+		struct Cache{
+			std::map<std::pair<int, int>, BigInt> G;
+			std::map<std::vector<unsigned int>, double> C;
+		};
+
 	private:
 		// Pattern data
 		std::vector<std::string> m_Symbols;
+		std::vector<unsigned int> m_SymbolIds;
 
-		// Sequence state
+		// Sequence state, counts are indexed by position in the pattern
 		unsigned int m_ActiveSymbol;
-		std::map<std::string, unsigned int> m_SymbolCounts;
-		std::map<std::string, unsigned int> m_TotalSymbolCounts;
+		std::vector<unsigned int> m_SymbolCounts;
+		std::vector<unsigned int> m_TotalSymbolCounts;
 
-		// Probability statistics
-		std::vector<double> m_P;
+		// Probability statistics, m_P holds each distinct non-zero occurrence
+		// probability with the number of sequences it was seen for
+		std::map<double, unsigned int> m_P;
+		unsigned int m_NonZeroSequences;
 		double m_ExpectedValue;
 		double m_Variance;
 		unsigned int m_RealValue;
 
+		// Standard error of Support() - ExpectedValue() after scaling up
+		// statistics of a sample
+		bool m_Sampled;
+		double m_SampleError;
+
 		// verbosity level
 		unsigned int m_Verbose;
 
-		static std::map<std::pair<int, int>, BigInt> m_G;
-		BigInt G(int b, int e);
+		// Memoization is per thread, see TakeCache and MergeCache
+		static thread_local std::map<std::pair<int, int>, BigInt> m_G;
+		static BigInt G(int b, int e);
+		static thread_local std::vector<double> m_LogFactorial;
+		static double LogG(int b, int e);
 
 		// Compute the permutation probability exactly
-		static std::map<std::vector<unsigned int>, double> m_C;
-		double C(std::vector<unsigned int> X);
+		static CMethod m_CMethod;
+		static thread_local std::map<std::vector<unsigned int>, double> m_C;
+		static const CCache* m_StoredC;
+		static thread_local PrefixCache m_Prefixes;
+		static double C(std::vector<unsigned int> X);
+		// Both methods resume from and store prefix states when given a cache
+		static double CBigInt(std::vector<unsigned int> X, PrefixCache* prefixes);
+		static double CLog(std::vector<unsigned int> X, PrefixCache* prefixes);
+		// Same recursion in O(l·X[n]) per step by summing over the start of
+		// the previous symbols' span first, binomials from a Pascal table
+		static double CPrefix(std::vector<unsigned int> X, PrefixCache* prefixes);
+		static double CMethodValue(std::vector<unsigned int> X, CMethod method, PrefixCache* prefixes);
+		// Print a count vector with both values and return the relative error
+		static double CompareC(const std::vector<unsigned int>& X, CMethod method, std::ostream& out);
 
 		double OccursProbability();
 
+		// With deferred evaluation sequences only add their sorted count vector
+		// to a histogram, which FillDeferred turns into the probability sums
+		static bool m_Deferred;
+		std::map<std::vector<unsigned int>, unsigned int> m_Vectors;
+
+		// Specialized evaluation for patterns of N symbols. Up to
+		// C_FIXED_CAPACITY symbols in total the recursion runs on stack buffers
+		// with binomials from a table. Results are memoized like those of C.
+		static const unsigned int C_FIXED_CAPACITY = 64;
+		static bool m_FixedKernels;
+		static double m_PTolerance;
+		static const double* Binomials();
+		template<unsigned int N> static double CFixed(const std::array<unsigned int, N>& X);
+		// The kernel value for a sorted count vector, false if none applies
+		static bool CFixedValue(const std::vector<unsigned int>& X, double& result);
+		// Distribution of the support under the null hypothesis, up to the
+		// given limit where the last entry holds P(support >= limit)
+		std::vector<double> SupportDistribution(unsigned int limit) const;
+
 		#ifdef SIGSPAN
-		double* Sigspan(double* probabilities, unsigned int pattern_length, unsigned int sequence_length) const;
+		// Expected value given by SetExpectedValueSigspan with the symbol
+		// totals it was computed for, stale when those have changed since
+		double m_SigspanExpected;
+		std::vector<unsigned int> m_SigspanTotals;
 		#endif
 
 	public:
-		Pattern(std::vector<std::string> patternSymbols, unsigned int verbosity);
-		Pattern(std::vector<std::string> patternSymbols);
+		Pattern(std::vector<std::string> patternSymbols, SymbolTable& symbols, unsigned int verbosity);
+		Pattern(std::vector<std::string> patternSymbols, SymbolTable& symbols);
+
+		// Symbols of the pattern and their ids, in pattern order
+		const std::vector<std::string>& Symbols() const;
+		const std::vector<unsigned int>& SymbolIds() const;
 
 		// Get data for currently processed sequences
 		double StandardDeviation() const;
@@ -54,24 +123,102 @@ class Pattern
 		unsigned int Support() const;
 		double PNormal() const;
 		double PExact() const;
+		// Exact p-value of every possible support, entry s is P(support >= s)
+		std::vector<double> PExactTail() const;
 		double PPoisson() const;
+		// P-value from the cheapest of the exact distribution, the normal or
+		// saddle-point approximation and the Poisson approximation whose error
+		// bound stays within the tolerance set by SetPTolerance, in log space
+		double LogPAuto(PValue::Method& method) const;
+		double LogPAuto() const;
+		double PAuto() const;
+		// Cheap lower bound on log(PExact()) from the support, the expected
+		// value and the variance, without the convolution
+		double LogPLowerBound() const;
+		// Saddle-point approximation of log(PExact()) for statistics scaled up
+		// from a sample, whose error is dominated by the sampling error
+		double LogPSampled() const;
 		#ifdef SIGSPAN
 		double ExpectedValueSigspan(std::map<unsigned int, unsigned int> dataset_shape) const;
 		double PSigspan(std::map<unsigned int, unsigned int> dataset_shape) const;
+		// Symbol probabilities used by SigSpan, in pattern order
+		std::vector<double> SigspanProbabilities(unsigned int dataset_size) const;
+		// Keep an expected value computed in a batch for the same dataset shape
+		void SetExpectedValueSigspan(double expected);
 		#endif
 		unsigned int NonZeroSequences() const;
 
 		// Process the last symbols seen
-		void Process(bool onlyCount);
+		void Process(const StatisticsPlan& plan);
 		void Process();
-		// Handle a new symbol for the current sequence
-		bool SymbolSeen(std::string symbol, bool onlyCount);
-		bool SymbolSeen(std::string symbol);
+		// Handle a whole sequence at once, given how many leading pattern symbols
+		// occurred in order and the sequence's count per symbol id
+		void SequenceSeen(unsigned int matched, const std::vector<unsigned int>& symbolCounts, const StatisticsPlan& plan);
 		// Clear for new sequence
 		void Reset();
 		void Clear();
+		// Add the statistics of the same pattern over sequences following ours.
+		// Counts and the probability histogram are exact, the expected value
+		// and variance are sums of partial sums and equal a single pass only up
+		// to rounding.
+		void Merge(const Pattern& other);
+		// Take all statistics but the support from a pattern with the same
+		// symbols in another order
+		void ShareStatistics(const Pattern& group);
+		// Scale statistics over a uniform sample of sequences to the whole
+		// dataset, keeping the standard error of the estimate
+		void Scale(uint64_t population, unsigned int sampled);
+		bool Sampled() const;
+		double SampleError() const;
+		// This pattern at the lower and upper end of the 95% confidence
+		// interval of its support, for bounds on estimated p-values
+		std::pair<Pattern, Pattern> SupportInterval() const;
+		// Write or read the accumulated statistics in binary form, processing
+		// can continue after reading them
+		void WriteState(std::ostream& out) const;
+		bool ReadState(std::istream& in);
 
 		// Create a string describing this pattern
 		std::string ToString() const;
+
+		// Select the method used for all permutation probabilities
+		static void SetCMethod(CMethod method);
+		// Method by name: bigint, log or prefix
+		static bool ParseCMethod(const char* name, CMethod& method);
+		// Identifies the method in cache files, together with whether the
+		// kernels for 2 to 4 symbols are used
+		static uint32_t CMethodId();
+		// Occurrence probability of sorted non-zero counts, as Process computes it
+		static double OccursProbability(const std::vector<unsigned int>& X);
+		// Record count vectors during passes and evaluate them afterwards
+		static void SetDeferred(bool enabled);
+		static bool Deferred();
+		// The distinct count vectors recorded since the last FillDeferred
+		const std::map<std::vector<unsigned int>, unsigned int>& DeferredVectors() const;
+		// Add the recorded vectors to the sums given their probabilities
+		void FillDeferred(const std::map<std::vector<unsigned int>, double>& probabilities, const StatisticsPlan& plan);
+		// Absolute error allowed for LogPAuto, 0 when not in use
+		static void SetPTolerance(double tolerance);
+		static double PTolerance();
+		// Use the specialized evaluation for patterns of 2 to 4 symbols
+		static void SetFixedKernels(bool enabled);
+		static bool FixedKernels();
+		// Move the memoized values out of the calling thread
+		static Cache TakeCache();
+		// Add memoized values to those of the calling thread
+		static void MergeCache(Cache& cache);
+		// Number of memoized values of the calling thread
+		static void CacheEntries(size_t& c, size_t& g);
+		// Read permutation probabilities from a cache file before computing them,
+		// values computed since stay in the memo of the thread for saving
+		static void SetStoredC(const CCache* stored);
+		// Compute the permutation probabilities of all sorted count vectors up to
+		// the given bounds into the memo of the calling thread
+		static void PrecomputeC(unsigned int maxLength, unsigned int maxCount);
+		// Compare a method to the BigInt method on all sorted count vectors up
+		// to the given bounds, returns the max relative error
+		static double ValidateC(unsigned int maxLength, unsigned int maxCount, CMethod method, std::ostream& out);
+		// Compare a method to the BigInt method on the given count vectors
+		static double ValidateC(const std::map<std::vector<unsigned int>, double>& vectors, CMethod method, std::ostream& out);
 };
 #endif
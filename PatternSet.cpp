@@ -0,0 +1,179 @@
+#include "PatternSet.h"
+
+#include <limits>
+
+PatternSet::PatternSet(unsigned int verbosity):
+	m_Trie(0),
+	m_Bytes(0),
+	m_ProbabilityBytes(0),
+	m_VectorBytes(0),
+	m_Verbose(verbosity)
+{
+}
+
+PatternSet::PatternSet(const SymbolTable& symbols, unsigned int verbosity):
+	m_Symbols(symbols),
+	m_Trie(0),
+	m_Bytes(0),
+	m_ProbabilityBytes(0),
+	m_VectorBytes(0),
+	m_Verbose(verbosity)
+{
+}
+
+void PatternSet::Add(std::vector<std::string> patternSymbols)
+{
+	unsigned int index = m_Patterns.size();
+	m_Patterns.push_back(Pattern(patternSymbols, m_Symbols, m_Verbose));
+
+	const std::vector<unsigned int>& ids = m_Patterns.back().SymbolIds();
+	std::vector<unsigned int> set = ids;
+	std::sort(set.begin(), set.end());
+	m_Group.push_back(m_Groups.emplace(set, index).first->second);
+	m_Trie.Add(ids, m_Group[index] != index);
+	if (m_Occurrences.size() < m_Symbols.Size()){
+		m_Occurrences.resize(m_Symbols.Size());
+	}
+	for (unsigned int position = 0; position < ids.size(); ++position){
+		m_Occurrences[ids[position]].push_back(std::make_pair(index, position));
+	}
+
+	// Per symbol the name, three counters in the pattern, an occurrence, the
+	// group key and at most one trie node with its child link, path and
+	// index entries
+	for (auto const& symbol: patternSymbols){
+		m_Bytes += sizeof(std::string) + (symbol.size() >= sizeof(std::string) ? symbol.size() + 1 : 0);
+	}
+	m_Bytes += ids.size() * (4 * sizeof(unsigned int) + sizeof(std::pair<unsigned int, unsigned int>) + 128) + 64;
+
+	if (m_ProbabilityBytes == 0 && m_VectorBytes == 0) return;
+	// Distinct count vectors are at most the sequences containing every
+	// symbol and the product of the largest counts. Each gives at most one
+	// histogram entry, kept by every pattern of the group after the pass, and
+	// one count vector of the first pattern.
+	double vectors = std::numeric_limits<unsigned int>::max();
+	double combinations = 1;
+	for (unsigned int id: ids){
+		bool seen = id < m_SymbolSequences.size();
+		vectors = std::min(vectors, seen ? (double) m_SymbolSequences[id] : 0.0);
+		combinations *= (seen ? m_SymbolMaxCounts[id] : 0);
+	}
+	vectors = std::min(vectors, combinations);
+	m_Bytes += vectors * m_ProbabilityBytes;
+	if (m_Group[index] == index) m_Bytes += vectors * (m_VectorBytes + ids.size() * sizeof(unsigned int));
+}
+
+void PatternSet::BoundHistograms(const std::vector<unsigned int>& sequences, const std::vector<unsigned int>& maxCounts, bool distribution, bool deferred)
+{
+	m_SymbolSequences = sequences;
+	m_SymbolMaxCounts = maxCounts;
+	// A map node holds three links and a color besides the value, vectors
+	// add their own allocation
+	const size_t node = 4 * sizeof(void*);
+	m_ProbabilityBytes = (distribution ? node + sizeof(std::pair<const double, unsigned int>) : 0);
+	m_VectorBytes = (deferred ? node + sizeof(std::pair<const std::vector<unsigned int>, unsigned int>) + 16 : 0);
+}
+
+std::vector<Pattern>& PatternSet::Patterns()
+{
+	return m_Patterns;
+}
+
+const std::vector<Pattern>& PatternSet::Patterns() const
+{
+	return m_Patterns;
+}
+
+SymbolTable& PatternSet::Symbols()
+{
+	return m_Symbols;
+}
+
+const SymbolTable& PatternSet::Symbols() const
+{
+	return m_Symbols;
+}
+
+unsigned int PatternSet::Size() const
+{
+	return m_Patterns.size();
+}
+
+size_t PatternSet::EstimatedBytes() const
+{
+	return m_Bytes + m_Patterns.capacity() * sizeof(Pattern);
+}
+
+const std::vector<std::pair<unsigned int, unsigned int>>& PatternSet::Occurrences(unsigned int symbolId) const
+{
+	static const std::vector<std::pair<unsigned int, unsigned int>> none;
+	if (symbolId >= m_Occurrences.size()) return none;
+	return m_Occurrences[symbolId];
+}
+
+void PatternSet::SymbolSeen(std::string_view symbol)
+{
+	// Symbols that are not part of any pattern were never interned
+	unsigned int symbolId;
+	if (m_Symbols.Find(symbol, symbolId)){
+		SymbolSeen(symbolId);
+	}
+}
+
+void PatternSet::SymbolSeen(unsigned int symbolId)
+{
+	m_Trie.SymbolSeen(symbolId);
+}
+
+void PatternSet::Process(const StatisticsPlan& plan)
+{
+	// Only the extra verbose trace needs every pattern to report
+	m_Trie.Process(m_Patterns, plan, m_Verbose >= 2);
+}
+
+void PatternSet::Reset()
+{
+	for (auto& p: m_Patterns){
+		p.Reset();
+	}
+	m_Trie.Clear();
+}
+
+void PatternSet::ShareGroups()
+{
+	for (unsigned int i = 0; i < m_Patterns.size(); ++i){
+		if (m_Group[i] != i) m_Patterns[i].ShareStatistics(m_Patterns[m_Group[i]]);
+	}
+}
+
+void PatternSet::ApplyShard(const Dataset& dataset, unsigned int first, unsigned int last, const StatisticsPlan& plan)
+{
+	// Trie of the shard's own patterns, with local sequence state
+	PatternTrie trie(first);
+	for (unsigned int p = first; p < last; ++p){
+		trie.Add(m_Patterns[p].SymbolIds(), m_Group[p] != p);
+	}
+
+	for (unsigned int i = 0; i < dataset.Sequences(); ++i){
+		for (const unsigned int* s = dataset.Begin(i); s != dataset.End(i); ++s){
+			trie.SymbolSeen(*s);
+		}
+		trie.Process(m_Patterns, plan, false);
+	}
+}
+
+#ifdef SIGSPAN
+void PatternSet::ComputeSigspan(const std::map<unsigned int, unsigned int>& shape)
+{
+	SigspanEngine engine(shape);
+	std::vector<std::vector<double>> probabilities;
+	probabilities.reserve(m_Patterns.size());
+	for (auto const& p: m_Patterns){
+		probabilities.push_back(p.SigspanProbabilities(engine.DatasetSize()));
+	}
+	std::vector<double> expected = engine.ExpectedValues(probabilities);
+	for (unsigned int i = 0; i < m_Patterns.size(); ++i){
+		m_Patterns[i].SetExpectedValueSigspan(expected[i]);
+	}
+}
+#endif
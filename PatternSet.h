@@ -0,0 +1,94 @@
+#ifndef PATTERNSET_H
+#define PATTERNSET_H
+
+#include "Dataset.h"
+#include "Pattern.h"
+#include "PatternTrie.h"
+#include "SymbolTable.h"
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The loaded patterns together with an inverted index from symbol ids
+// to the patterns containing them, and a trie of the patterns matching the
+// symbols of the current sequence.
+//
+// Occurrence probabilities only depend on the set of pattern symbols, so
+// patterns are grouped by symbol set. Only the first pattern of a group
+// computes them, the other members count their support and copy the rest
+// from the first once a pass is done.
+class PatternSet{
+	private:
+		SymbolTable m_Symbols;
+		std::vector<Pattern> m_Patterns;
+
+		// Per symbol id the (pattern, position) pairs where it occurs
+		std::vector<std::vector<std::pair<unsigned int, unsigned int>>> m_Occurrences;
+
+		// Per pattern the first pattern with the same symbol set, by sorted ids
+		std::vector<unsigned int> m_Group;
+		std::map<std::vector<unsigned int>, unsigned int> m_Groups;
+
+		// State of the current sequence
+		PatternTrie m_Trie;
+
+		// Estimated memory of the patterns and indexes besides m_Patterns itself
+		size_t m_Bytes;
+
+		// Per symbol id the sequences containing it and its largest count in a
+		// sequence, bounding the histograms a pass fills, with the bytes per
+		// histogram entry and count vector
+		std::vector<unsigned int> m_SymbolSequences;
+		std::vector<unsigned int> m_SymbolMaxCounts;
+		size_t m_ProbabilityBytes;
+		size_t m_VectorBytes;
+
+		// verbosity level
+		unsigned int m_Verbose;
+
+	public:
+		PatternSet(unsigned int verbosity);
+		// Start from known symbols, e.g. those of a dataset loaded before
+		PatternSet(const SymbolTable& symbols, unsigned int verbosity);
+
+		void Add(std::vector<std::string> patternSymbols);
+
+		std::vector<Pattern>& Patterns();
+		const std::vector<Pattern>& Patterns() const;
+		SymbolTable& Symbols();
+		const SymbolTable& Symbols() const;
+		unsigned int Size() const;
+		// Include an upper bound on the probability histograms and deferred
+		// count vectors a pass fills in the estimate of patterns added from now
+		// on, given the Dataset::SymbolStatistics of the data
+		void BoundHistograms(const std::vector<unsigned int>& sequences, const std::vector<unsigned int>& maxCounts, bool distribution, bool deferred);
+		// Estimate of the memory used by the patterns and their indexes,
+		// including histograms after BoundHistograms
+		size_t EstimatedBytes() const;
+
+		// The (pattern, position) pairs where a symbol occurs
+		const std::vector<std::pair<unsigned int, unsigned int>>& Occurrences(unsigned int symbolId) const;
+
+		// Handle a new symbol for the current sequence
+		void SymbolSeen(std::string_view symbol);
+		void SymbolSeen(unsigned int symbolId);
+		// Process the current sequence and clear for the next one
+		void Process(const StatisticsPlan& plan);
+		// Clear all patterns for a new pass over the data
+		void Reset();
+		// Give group members the statistics of their group after a pass
+		void ShareGroups();
+
+		// Process a whole dataset for the patterns in [first, last) only. Shards
+		// over disjoint ranges can be applied from different threads at once.
+		void ApplyShard(const Dataset& dataset, unsigned int first, unsigned int last, const StatisticsPlan& plan);
+
+		#ifdef SIGSPAN
+		// Compute the SigSpan expected values of all patterns in one batch
+		void ComputeSigspan(const std::map<unsigned int, unsigned int>& shape);
+		#endif
+};
+#endif
@@ -0,0 +1,123 @@
+#include "PatternTrie.h"
+
+PatternTrie::PatternTrie(unsigned int first):
+	m_First(first),
+	m_Parent(1, 0),
+	m_Ending(1),
+	m_EndingMembers(1),
+	m_Reached(1, true)
+{
+}
+
+void PatternTrie::Add(const std::vector<unsigned int>& symbolIds, bool member)
+{
+	unsigned int index = m_First + m_Paths.size();
+	std::vector<unsigned int> path;
+	unsigned int node = 0;
+	for (unsigned int id: symbolIds){
+		if (m_Nodes.size() <= id){
+			m_Nodes.resize(id + 1);
+			m_Containing.resize(id + 1);
+			m_Counts.resize(id + 1, 0);
+		}
+		auto child = m_Children.find(std::make_pair(node, id));
+		if (child == m_Children.end()){
+			unsigned int next = m_Parent.size();
+			m_Parent.push_back(node);
+			m_Ending.emplace_back();
+			m_EndingMembers.emplace_back();
+			m_Reached.push_back(false);
+			m_Nodes[id].push_back(next);
+			child = m_Children.emplace(std::make_pair(node, id), next).first;
+		}
+		node = child->second;
+		path.push_back(node);
+		if (!member) m_Containing[id].push_back(index);
+	}
+	(member ? m_EndingMembers : m_Ending)[node].push_back(index);
+	m_Paths.push_back(path);
+	m_IsTouched.push_back(false);
+}
+
+void PatternTrie::SymbolSeen(unsigned int symbolId)
+{
+	if (symbolId >= m_Nodes.size() || m_Nodes[symbolId].empty()) return;
+
+	if (m_Counts[symbolId]++ == 0) m_Seen.push_back(symbolId);
+	// Symbols are unique within a pattern, so a node never shares its symbol
+	// with its parent and the order of the nodes does not matter
+	for (unsigned int node: m_Nodes[symbolId]){
+		if (!m_Reached[node] && m_Reached[m_Parent[node]]){
+			m_Reached[node] = true;
+			m_ReachedNodes.push_back(node);
+		}
+	}
+}
+
+void PatternTrie::Apply(std::vector<Pattern>& patterns, unsigned int pattern, const StatisticsPlan& plan)
+{
+	// Reached prefixes of a pattern are its first nodes
+	const std::vector<unsigned int>& path = m_Paths[pattern - m_First];
+	unsigned int matched = 0;
+	while (matched < path.size() && m_Reached[path[matched]]){
+		matched++;
+	}
+	patterns[pattern].SequenceSeen(matched, m_Counts, plan);
+	patterns[pattern].Process(plan);
+	patterns[pattern].Clear();
+}
+
+void PatternTrie::Process(std::vector<Pattern>& patterns, const StatisticsPlan& plan, bool all)
+{
+	if (all){
+		for (unsigned int i = 0; i < m_Paths.size(); ++i){
+			Apply(patterns, m_First + i, plan);
+		}
+	} else if (!plan.nonZero && !plan.Probabilities() && !plan.symbolTotals){
+		// Only the support is needed, which only patterns fully reached add to
+		for (unsigned int node: m_ReachedNodes){
+			for (unsigned int p: m_Ending[node]){
+				Apply(patterns, p, plan);
+			}
+			for (unsigned int p: m_EndingMembers[node]){
+				Apply(patterns, p, plan);
+			}
+		}
+	} else {
+		// Untouched patterns have all counts at zero and contribute nothing
+		for (unsigned int id: m_Seen){
+			for (unsigned int p: m_Containing[id]){
+				if (!m_IsTouched[p - m_First]){
+					m_IsTouched[p - m_First] = true;
+					m_Touched.push_back(p);
+				}
+			}
+		}
+		for (unsigned int p: m_Touched){
+			Apply(patterns, p, plan);
+			m_IsTouched[p - m_First] = false;
+		}
+		m_Touched.clear();
+
+		// Group members share the rest with their group afterwards
+		static const StatisticsPlan supportOnly(std::vector<char>(), false);
+		for (unsigned int node: m_ReachedNodes){
+			for (unsigned int p: m_EndingMembers[node]){
+				Apply(patterns, p, supportOnly);
+			}
+		}
+	}
+	Clear();
+}
+
+void PatternTrie::Clear()
+{
+	for (unsigned int id: m_Seen){
+		m_Counts[id] = 0;
+	}
+	m_Seen.clear();
+	for (unsigned int node: m_ReachedNodes){
+		m_Reached[node] = false;
+	}
+	m_ReachedNodes.clear();
+}
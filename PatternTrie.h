@@ -0,0 +1,59 @@
+#ifndef PATTERNTRIE_H
+#define PATTERNTRIE_H
+
+#include "Pattern.h"
+#include "StatisticsPlan.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+// Patterns merged on their shared prefixes. Each node is a pattern prefix
+// and is reached once all its symbols occurred in order in the current
+// sequence, so the ordered occurrence check runs once per node instead of
+// once per pattern. Symbol counts are kept per sequence and handed to the
+// patterns when the sequence is processed. Group members, patterns with the
+// symbols of an earlier pattern in another order, only get their support.
+class PatternTrie{
+	private:
+		// Patterns are numbered from m_First in the order they were added
+		unsigned int m_First;
+
+		// Node 0 is the empty prefix
+		std::vector<unsigned int> m_Parent;
+		std::map<std::pair<unsigned int, unsigned int>, unsigned int> m_Children;
+		// Per symbol id the nodes ending in it
+		std::vector<std::vector<unsigned int>> m_Nodes;
+		// Per node the patterns and the group members ending there
+		std::vector<std::vector<unsigned int>> m_Ending;
+		std::vector<std::vector<unsigned int>> m_EndingMembers;
+		// Per pattern the nodes of its prefixes
+		std::vector<std::vector<unsigned int>> m_Paths;
+		// Per symbol id the patterns containing it, without group members
+		std::vector<std::vector<unsigned int>> m_Containing;
+
+		// Sequence state
+		std::vector<unsigned int> m_Counts;
+		std::vector<unsigned int> m_Seen;
+		std::vector<char> m_Reached;
+		std::vector<unsigned int> m_ReachedNodes;
+		std::vector<char> m_IsTouched;
+		std::vector<unsigned int> m_Touched;
+
+		void Apply(std::vector<Pattern>& patterns, unsigned int pattern, const StatisticsPlan& plan);
+
+	public:
+		PatternTrie(unsigned int first);
+
+		// Add the next pattern by its symbol ids
+		void Add(const std::vector<unsigned int>& symbolIds, bool member);
+
+		// Handle a symbol of the current sequence
+		void SymbolSeen(unsigned int symbolId);
+		// Hand the current sequence to the patterns, process them and clear for
+		// the next one. Untouched patterns are skipped unless all is set.
+		void Process(std::vector<Pattern>& patterns, const StatisticsPlan& plan, bool all);
+		// Clear the current sequence without processing it
+		void Clear();
+};
+#endif
@@ -0,0 +1,77 @@
+#include "PrefixCache.h"
+
+PrefixCache::PrefixCache():
+	m_Bytes(0)
+{
+}
+
+size_t PrefixCache::Bytes(const std::vector<unsigned int>& prefix, const std::vector<double>& state){
+	// Key stored twice (map and age list) plus rough node overheads
+	return 2 * prefix.size() * sizeof(unsigned int) + state.size() * sizeof(double) + 128;
+}
+
+unsigned int PrefixCache::Resume(const std::vector<unsigned int>& X, std::vector<double>& state){
+	if (m_Budget == 0) return 0;
+
+	std::vector<unsigned int> prefix(X.begin(), X.end() - 1);
+	while (prefix.size() >= 2){
+		auto search = m_Entries.find(prefix);
+		if (search != m_Entries.end()){
+			m_Ages.splice(m_Ages.begin(), m_Ages, search->second.age);
+			std::copy(search->second.state.begin(), search->second.state.end(), state.begin());
+			m_Hits++;
+			return prefix.size();
+		}
+		prefix.pop_back();
+	}
+	m_Misses++;
+	return 0;
+}
+
+void PrefixCache::Store(const std::vector<unsigned int>& X, unsigned int length, const std::vector<double>& state){
+	std::vector<unsigned int> prefix(X.begin(), X.begin() + length);
+	unsigned int size = 0;
+	for (unsigned int x: prefix){
+		size += x;
+	}
+	std::vector<double> used(state.begin(), state.begin() + size);
+
+	size_t bytes = Bytes(prefix, used);
+	if (bytes > m_Budget || m_Entries.find(prefix) != m_Entries.end()) return;
+
+	while (m_Bytes + bytes > m_Budget){
+		auto oldest = m_Entries.find(m_Ages.back());
+		m_Bytes -= Bytes(oldest->first, oldest->second.state);
+		m_Entries.erase(oldest);
+		m_Ages.pop_back();
+		m_Evictions++;
+	}
+
+	m_Ages.push_front(prefix);
+	m_Entries[prefix] = Entry{used, m_Ages.begin()};
+	m_Bytes += bytes;
+}
+
+void PrefixCache::SetBudget(size_t bytes){
+	m_Budget = bytes;
+}
+
+size_t PrefixCache::Budget(){
+	return m_Budget;
+}
+
+void PrefixCache::Report(std::ostream& out){
+	out << "C prefix cache: " << m_Hits << " hits, " << m_Misses << " misses, "
+		<< m_Evictions << " evictions" << std::endl;
+}
+
+size_t PrefixCache::m_Budget = 64 << 20;
+std::atomic<unsigned long> PrefixCache::m_Hits(0);
+std::atomic<unsigned long> PrefixCache::m_Misses(0);
+std::atomic<unsigned long> PrefixCache::m_Evictions(0);
+
+void PrefixCache::Counts(unsigned long& hits, unsigned long& misses, unsigned long& evictions){
+	hits = m_Hits;
+	misses = m_Misses;
+	evictions = m_Evictions;
+}
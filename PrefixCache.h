@@ -0,0 +1,46 @@
+#ifndef PREFIXCACHE_H
+#define PREFIXCACHE_H
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <ostream>
+#include <vector>
+
+// Least recently used cache of intermediate states of the permutation
+// probability recursion, keyed by the prefix of the sorted count vector
+// they were computed from. The byte budget applies per cache, one cache is
+// kept per thread.
+class PrefixCache{
+	private:
+		struct Entry{
+			std::vector<double> state;
+			std::list<std::vector<unsigned int>>::iterator age;
+		};
+		std::map<std::vector<unsigned int>, Entry> m_Entries;
+		// Most recently used first
+		std::list<std::vector<unsigned int>> m_Ages;
+		size_t m_Bytes;
+
+		static size_t m_Budget;
+		static std::atomic<unsigned long> m_Hits;
+		static std::atomic<unsigned long> m_Misses;
+		static std::atomic<unsigned long> m_Evictions;
+
+		static size_t Bytes(const std::vector<unsigned int>& prefix, const std::vector<double>& state);
+
+	public:
+		PrefixCache();
+
+		// Copy the state of the longest cached proper prefix of X into state,
+		// returns the prefix length or 0 if there is none
+		unsigned int Resume(const std::vector<unsigned int>& X, std::vector<double>& state);
+		// Store the state computed from the first length counts of X
+		void Store(const std::vector<unsigned int>& X, unsigned int length, const std::vector<double>& state);
+
+		static void SetBudget(size_t bytes);
+		static size_t Budget();
+		static void Report(std::ostream& out);
+		static void Counts(unsigned long& hits, unsigned long& misses, unsigned long& evictions);
+};
+#endif
@@ -0,0 +1,88 @@
+#include "ResultFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+ResultFilter::ResultFilter(double threshold, unsigned int k):
+	m_LogThreshold(threshold < 1 ? log(threshold) : std::numeric_limits<double>::infinity()),
+	m_K(k),
+	m_Offered(0),
+	m_Pruned(0),
+	m_Kept(0)
+{
+}
+
+bool ResultFilter::Active() const
+{
+	return m_LogThreshold != std::numeric_limits<double>::infinity() || m_K != 0;
+}
+
+bool ResultFilter::TopK() const
+{
+	return m_K != 0;
+}
+
+bool ResultFilter::Full() const
+{
+	return m_K != 0 && m_Best.size() >= m_K;
+}
+
+bool ResultFilter::Admit(const Pattern& p, unsigned int index, double& logP)
+{
+	if (!Active()) return true;
+	m_Offered++;
+
+	// Patterns that cannot beat the threshold or the least significant of the
+	// top k are skipped before their p-value is computed, with a margin as the
+	// bound may equal the p-value up to rounding
+	double bound = p.LogPLowerBound() - 1e-9;
+	// The --p-auto value may be up to the tolerance below the exact one
+	double tolerance = Pattern::PTolerance();
+	if (tolerance > 0) bound = log(std::max(exp(bound) - tolerance, 0.0));
+	if (bound > m_LogThreshold || (Full() && bound > std::get<0>(m_Best.front()))){
+		m_Pruned++;
+		return false;
+	}
+
+	logP = LogP(p);
+	if (logP > m_LogThreshold) return false;
+	if (Full() && std::make_pair(logP, index) >= std::make_pair(std::get<0>(m_Best.front()), std::get<1>(m_Best.front()))) return false;
+	return true;
+}
+
+void ResultFilter::Keep(double logP, unsigned int index, const std::string& line, std::ostream& out)
+{
+	if (m_K == 0){
+		m_Kept++;
+		if (line != "") out << line << std::endl;
+		return;
+	}
+
+	if (Full()){
+		std::pop_heap(m_Best.begin(), m_Best.end());
+		m_Best.pop_back();
+	}
+	m_Best.emplace_back(logP, index, line);
+	std::push_heap(m_Best.begin(), m_Best.end());
+}
+
+void ResultFilter::Flush(std::ostream& out)
+{
+	std::sort_heap(m_Best.begin(), m_Best.end());
+	for (auto const& best: m_Best){
+		if (std::get<2>(best) != "") out << std::get<2>(best) << std::endl;
+	}
+	m_Kept += m_Best.size();
+	m_Best.clear();
+}
+
+void ResultFilter::Report(std::ostream& out) const
+{
+	out << m_Kept << " of " << m_Offered << " patterns kept, " << m_Pruned << " skipped on a bound of their p-value." << std::endl;
+}
+
+double ResultFilter::LogP(const Pattern& p)
+{
+	return (Pattern::PTolerance() > 0 ? p.LogPAuto() : log(p.PExact()));
+}
@@ -0,0 +1,52 @@
+#ifndef RESULTFILTER_H
+#define RESULTFILTER_H
+
+#include "Pattern.h"
+
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Restricts the output to the patterns whose p-value is within a significance
+// threshold, to the k most significant, or both. The p-value is the exact one,
+// or the one of --p-auto, and is only computed for patterns whose lower bound
+// does not already rule them out.
+class ResultFilter{
+	private:
+		double m_LogThreshold;
+		unsigned int m_K;
+		unsigned int m_Offered;
+		unsigned int m_Pruned;
+		unsigned int m_Kept;
+
+		// Max-heap on (log p-value, index) of the most significant lines so far
+		std::vector<std::tuple<double, unsigned int, std::string>> m_Best;
+
+		bool Full() const;
+
+	public:
+		// Keep patterns with a p-value of at most threshold, 1 for all, and
+		// only the k most significant of those, 0 for all
+		ResultFilter(double threshold, unsigned int k);
+
+		// Whether any pattern is left out
+		bool Active() const;
+		// Only the k most significant are kept
+		bool TopK() const;
+
+		// Whether pattern number index can be kept, with the log of its p-value
+		bool Admit(const Pattern& p, unsigned int index, double& logP);
+		// Write the line of an admitted pattern, held back while the top k are
+		// not known yet
+		void Keep(double logP, unsigned int index, const std::string& line, std::ostream& out);
+		// Write the held lines, most significant first
+		void Flush(std::ostream& out);
+
+		// Number of patterns offered, kept and skipped on their bound
+		void Report(std::ostream& out) const;
+
+		// Log of the p-value patterns are selected on
+		static double LogP(const Pattern& p);
+};
+#endif
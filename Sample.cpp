@@ -0,0 +1,71 @@
+#include "Sample.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string_view>
+#include <vector>
+
+Sample::Sample(TokenReader& reader, SymbolTable& symbols, unsigned int size, uint64_t seed):
+	m_Sequences(0)
+{
+	std::seed_seq seedSequence{(uint32_t) seed, (uint32_t) (seed >> 32)};
+	std::mt19937_64 generator(seedSequence);
+
+	// Whether the current sequence is kept is decided at its first symbol,
+	// so skipped sequences are never interned
+	std::vector<std::vector<unsigned int>> reservoir;
+	std::vector<unsigned int>* slot = nullptr;
+	bool decided = false;
+	unsigned int length = 0;
+	std::string_view item;
+	while (reader.Item(item)){
+		if (!decided){
+			if (m_Sequences < size){
+				reservoir.emplace_back();
+				slot = &reservoir.back();
+			} else {
+				std::uniform_int_distribution<uint64_t> position(0, m_Sequences);
+				uint64_t j = position(generator);
+				slot = (j < size ? &reservoir[j] : nullptr);
+				if (slot) slot->clear();
+			}
+			decided = true;
+		}
+		if (item == "\n"){
+			m_Shape[length]++;
+			m_Sequences++;
+			length = 0;
+			decided = false;
+			continue;
+		}
+		length++;
+		if (slot) slot->push_back(symbols.Intern(item));
+	}
+
+	for (auto const& sequence: reservoir){
+		m_Dataset.Append(sequence);
+	}
+}
+
+const Dataset& Sample::Data() const
+{
+	return m_Dataset;
+}
+
+const std::map<unsigned int, uint64_t>& Sample::Shape() const
+{
+	return m_Shape;
+}
+
+uint64_t Sample::Sequences() const
+{
+	return m_Sequences;
+}
+
+unsigned int Sample::SizeForError(double error)
+{
+	// The variance of a fraction is at most 1/4
+	const double z = 1.959963984540054;
+	return (unsigned int) std::min(std::ceil(z * z / (4 * error * error)), 4294967295.0);
+}
@@ -0,0 +1,34 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "Dataset.h"
+#include "SymbolTable.h"
+#include "TokenReader.h"
+
+#include <cstdint>
+#include <map>
+
+// A uniform sample of the sequences of a file, drawn in a single pass by
+// reservoir sampling. Only sampled sequences are kept, while the number of
+// sequences and their lengths are counted over the whole file.
+class Sample{
+	private:
+		Dataset m_Dataset;
+		std::map<unsigned int, uint64_t> m_Shape;
+		uint64_t m_Sequences;
+
+	public:
+		// Keep at most size sequences, chosen with a generator seeded from seed
+		Sample(TokenReader& reader, SymbolTable& symbols, unsigned int size, uint64_t seed);
+
+		// The sampled sequences
+		const Dataset& Data() const;
+		// Number of sequences per sequence length and in total in the file
+		const std::map<unsigned int, uint64_t>& Shape() const;
+		uint64_t Sequences() const;
+
+		// Sample size estimating the fraction of sequences supporting a
+		// pattern within the given error at 95% confidence
+		static unsigned int SizeForError(double error);
+};
+#endif
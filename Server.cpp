@@ -0,0 +1,197 @@
+#include "Server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Server::Connection::Connection(int in, int out, bool owned):
+	in(in),
+	out(out),
+	owned(owned)
+{
+}
+
+Server::Connection::~Connection(){
+	if (owned) close(in);
+}
+
+Server::Server(const SymbolTable& symbols, ScoreFunction score, FormatFunction format, std::string columns, unsigned int verbosity):
+	m_Symbols(symbols),
+	m_Score(score),
+	m_Format(format),
+	m_Columns(columns),
+	m_Verbose(verbosity),
+	m_Closing(false)
+{
+}
+
+bool Server::ParseColumns(const std::string& line, Request& request) const{
+	std::istringstream options(line);
+	std::string option;
+	while (options >> option){
+		if (option.size() != 2 || option[0] != '-' || m_Columns.find(option[1]) == std::string::npos){
+			request.error = option + " is not a valid output column";
+			return false;
+		}
+		request.columns.push_back(option[1]);
+	}
+	return true;
+}
+
+void Server::Send(const Connection& connection, const std::string& data){
+	// A client that went away only loses its own response
+	size_t sent = 0;
+	while (sent < data.size()){
+		ssize_t bytes = write(connection.out, data.data() + sent, data.size() - sent);
+		if (bytes < 0 && errno == EINTR) continue;
+		if (bytes <= 0) return;
+		sent += bytes;
+	}
+}
+
+void Server::Read(std::shared_ptr<Connection> connection){
+	std::string buffer;
+	char chunk[1 << 16];
+	Request request;
+	bool header = true;
+	bool finished = false;
+	while (!finished){
+		size_t end = buffer.find('\n');
+		std::string line;
+		if (end != std::string::npos){
+			line = buffer.substr(0, end);
+			buffer.erase(0, end + 1);
+		} else {
+			ssize_t bytes = read(connection->in, chunk, sizeof(chunk));
+			if (bytes < 0 && errno == EINTR) continue;
+			if (bytes > 0){
+				buffer.append(chunk, bytes);
+				continue;
+			}
+			// Whatever is left ends the last request
+			finished = true;
+			line = buffer;
+			if (header && line.empty()) break;
+		}
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+
+		if (header){
+			ParseColumns(line, request);
+			header = false;
+		} else if (!line.empty()){
+			std::vector<std::string> symbols;
+			std::string symbol;
+			std::istringstream lineStream(line);
+			while (std::getline(lineStream, symbol, ' ')){
+				symbols.push_back(symbol);
+			}
+			// Patterns reject repeated symbols, which must not end the scorer
+			std::vector<std::string> sorted = symbols;
+			std::sort(sorted.begin(), sorted.end());
+			if (request.error.empty() && std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()){
+				request.error = line + " repeats a symbol";
+			}
+			request.patterns.push_back(symbols);
+		}
+
+		if (!header && (line.empty() || finished)){
+			request.connection = connection;
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Requests.push_back(std::move(request));
+			m_Pending.notify_one();
+			request = Request();
+			header = true;
+		}
+	}
+}
+
+void Server::ScoreBatches(){
+	while (true){
+		std::vector<Request> batch;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Pending.wait(lock, [this](){ return !m_Requests.empty() || m_Closing; });
+			if (m_Requests.empty()) return;
+			batch.swap(m_Requests);
+		}
+
+		// One pass maintaining what any of the requests needs
+		PatternSet patterns(m_Symbols, 0);
+		std::vector<char> columns;
+		for (auto const& request: batch){
+			if (!request.error.empty()) continue;
+			columns.insert(columns.end(), request.columns.begin(), request.columns.end());
+			for (auto const& pattern: request.patterns){
+				patterns.Add(pattern);
+			}
+		}
+		if (patterns.Size() > 0) m_Score(patterns, StatisticsPlan(columns, false));
+		if (m_Verbose >= 1) std::cerr << batch.size() << " requests with " << patterns.Size() << " patterns scored." << std::endl;
+
+		unsigned int next = 0;
+		for (auto const& request: batch){
+			std::string response;
+			if (!request.error.empty()){
+				response = "error: " + request.error + "\n";
+			} else {
+				for (unsigned int i = 0; i < request.patterns.size(); ++i){
+					std::string result = m_Format(patterns.Patterns()[next++], request.columns);
+					if (!result.empty()) response += result + "\n";
+				}
+			}
+			Send(*request.connection, response + "\n");
+		}
+	}
+}
+
+void Server::ServeStdio(){
+	std::thread scorer(&Server::ScoreBatches, this);
+	Read(std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false));
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Closing = true;
+		m_Pending.notify_one();
+	}
+	scorer.join();
+}
+
+bool Server::ServeSocket(const std::string& path){
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) return false;
+	std::strcpy(address.sun_path, path.c_str());
+
+	// Replace a socket left behind by an earlier server, never another file
+	struct stat info;
+	if (stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path.c_str());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) return false;
+	if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0){
+		close(listener);
+		return false;
+	}
+	if (m_Verbose >= 1) std::cerr << "Listening on " << path << std::endl;
+
+	std::thread scorer(&Server::ScoreBatches, this);
+	scorer.detach();
+	while (true){
+		int client = accept(listener, nullptr, nullptr);
+		if (client < 0){
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+		std::thread(&Server::Read, this, std::make_shared<Connection>(client, client, true)).detach();
+	}
+	close(listener);
+	return false;
+}
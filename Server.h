@@ -0,0 +1,74 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "Pattern.h"
+#include "PatternSet.h"
+#include "StatisticsPlan.h"
+#include "SymbolTable.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scores batches of patterns against data kept in memory. Requests come from
+// stdin or from clients of a Unix domain socket, each one is
+//   a line of output columns, e.g. "-s -e -p"
+//   one line per pattern, symbols separated by spaces
+//   an empty line
+// and is answered with the result lines a normal run prints for those
+// patterns followed by an empty line, or "error: <reason>" and an empty line.
+// Requests arriving while a pass runs are scored together in the next pass.
+class Server{
+	public:
+		// Score all patterns in one pass over the data
+		typedef std::function<void(PatternSet&, const StatisticsPlan&)> ScoreFunction;
+		// Result line of a pattern for the given columns, empty if there is none
+		typedef std::function<std::string(const Pattern&, const std::vector<char>&)> FormatFunction;
+
+	private:
+		struct Connection{
+			int in;
+			int out;
+			bool owned;
+			Connection(int in, int out, bool owned);
+			~Connection();
+		};
+		struct Request{
+			std::shared_ptr<Connection> connection;
+			std::vector<char> columns;
+			std::vector<std::vector<std::string>> patterns;
+			std::string error;
+		};
+
+		const SymbolTable& m_Symbols;
+		ScoreFunction m_Score;
+		FormatFunction m_Format;
+		std::string m_Columns;
+		unsigned int m_Verbose;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_Pending;
+		std::vector<Request> m_Requests;
+		bool m_Closing;
+
+		// Read requests of a client until it closes
+		void Read(std::shared_ptr<Connection> connection);
+		// Score pending requests until closing
+		void ScoreBatches();
+		bool ParseColumns(const std::string& line, Request& request) const;
+		static void Send(const Connection& connection, const std::string& data);
+
+	public:
+		// Columns lists the valid column options
+		Server(const SymbolTable& symbols, ScoreFunction score, FormatFunction format, std::string columns, unsigned int verbosity);
+
+		// Serve a single client on stdin and stdout until stdin closes
+		void ServeStdio();
+		// Serve clients of a Unix domain socket until the process is stopped,
+		// false if the socket cannot be created
+		bool ServeSocket(const std::string& path);
+};
+#endif
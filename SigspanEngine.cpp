@@ -0,0 +1,148 @@
+#include "SigspanEngine.h"
+
+#ifdef SIGSPAN
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Bound on the number of cached powers over all probabilities
+static const size_t MAX_POWERS = 1 << 22;
+
+SigspanEngine::SigspanEngine(const std::map<unsigned int, unsigned int>& shape):
+	m_Shape(shape),
+	m_Length(0),
+	m_DatasetSize(0)
+{
+	for (auto const& x: m_Shape){
+		m_Length = std::max(x.first, m_Length);
+		m_DatasetSize += x.first * x.second;
+	}
+}
+
+unsigned int SigspanEngine::Length() const
+{
+	return m_Length;
+}
+
+unsigned int SigspanEngine::DatasetSize() const
+{
+	return m_DatasetSize;
+}
+
+const std::vector<double>& SigspanEngine::Powers(double p)
+{
+	auto found = m_Powers.find(p);
+	if (found != m_Powers.end()) return found->second;
+
+	if ((m_Powers.size() + 1) * m_Length > MAX_POWERS) m_Powers.clear();
+	// Computed with pow like the terms they replace, so results are unchanged
+	std::vector<double>& powers = m_Powers[p];
+	powers.resize(m_Length);
+	for (unsigned int i = 0; i < m_Length; ++i){
+		powers[i] = pow(1-p, i);
+	}
+	return powers;
+}
+
+void SigspanEngine::FirstLayer(double p, std::vector<double>& layer)
+{
+	const std::vector<double>& powers = Powers(p);
+	layer.resize(m_Length);
+	for (unsigned int i = 0; i < m_Length; ++i){
+		layer[i] = p * powers[i];
+	}
+}
+
+void SigspanEngine::NextLayer(const std::vector<double>& previous, unsigned int k, double p, std::vector<double>& layer)
+{
+	const std::vector<double>& powers = Powers(p);
+	layer.assign(m_Length, 0);
+
+	// Entry i is the sum over j < i of previous[j-1]·p·(1-p)^(i-j-1). Adding
+	// the terms per j keeps the order of each sum, while the loop over i has
+	// no dependencies and vectorizes.
+	for (unsigned int j = k - 1; j < m_Length; ++j){
+		double start = previous[j-1] * p;
+		double* out = layer.data() + j;
+		const double* geometric = powers.data();
+		unsigned int n = m_Length - j;
+		for (unsigned int i = 0; i < n; ++i){
+			out[i] += start * geometric[i];
+		}
+	}
+}
+
+void SigspanEngine::Accumulate(std::vector<double>& layer) const
+{
+	for (unsigned int i = 1; i < layer.size(); ++i){
+		layer[i] += layer[i-1];
+	}
+}
+
+std::vector<double> SigspanEngine::Occurrence(const std::vector<double>& probabilities)
+{
+	std::vector<double> layer;
+	std::vector<double> next;
+	if (probabilities.empty()) return std::vector<double>(m_Length, 0);
+
+	FirstLayer(probabilities[0], layer);
+	for (unsigned int k = 2; k <= probabilities.size(); ++k){
+		NextLayer(layer, k, probabilities[k-1], next);
+		layer.swap(next);
+	}
+	Accumulate(layer);
+	return layer;
+}
+
+double SigspanEngine::ExpectedValue(const std::vector<double>& occurrence, unsigned int patternLength) const
+{
+	double expected_support = 0;
+	for (auto it = m_Shape.lower_bound(patternLength); it != m_Shape.end(); ++it){
+		expected_support += it->second * occurrence[it->first - 1];
+	}
+	return expected_support;
+}
+
+std::vector<double> SigspanEngine::ExpectedValues(const std::vector<std::vector<double>>& probabilities)
+{
+	std::vector<double> result(probabilities.size(), 0);
+	if (m_Length == 0) return result;
+
+	// In sorted order consecutive patterns share the longest leading symbols
+	std::vector<unsigned int> order(probabilities.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+		return probabilities[a] < probabilities[b];
+	});
+
+	// layers[k] is valid for the leading probabilities in stack[0..k]
+	std::vector<std::vector<double>> layers;
+	std::vector<double> stack;
+	std::vector<double> occurrence;
+	for (unsigned int index: order){
+		const std::vector<double>& pattern = probabilities[index];
+		if (pattern.empty()) continue;
+
+		unsigned int shared = 0;
+		while (shared < stack.size() && shared < pattern.size() && stack[shared] == pattern[shared]){
+			shared++;
+		}
+		stack.resize(shared);
+		if (layers.size() < pattern.size()) layers.resize(pattern.size());
+
+		for (unsigned int k = shared; k < pattern.size(); ++k){
+			if (k == 0){
+				FirstLayer(pattern[0], layers[0]);
+			} else {
+				NextLayer(layers[k-1], k + 1, pattern[k], layers[k]);
+			}
+			stack.push_back(pattern[k]);
+		}
+
+		occurrence = layers[pattern.size() - 1];
+		Accumulate(occurrence);
+		result[index] = ExpectedValue(occurrence, pattern.size());
+	}
+	return result;
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef SIGSPANENGINE_H
+#define SIGSPANENGINE_H
+
+#ifdef SIGSPAN
+#include <map>
+#include <vector>
+
+// SigSpan probability that a pattern occurs in a random sequence of each
+// length. Layer k of the DP holds per length the probability that the first
+// k symbols end exactly at its last position. Layers only depend on the
+// probabilities of the leading symbols, so patterns sharing those reuse them.
+class SigspanEngine{
+	private:
+		std::map<unsigned int, unsigned int> m_Shape;
+		unsigned int m_Length;
+		unsigned int m_DatasetSize;
+
+		// Per probability p the powers (1-p)^i for i < m_Length
+		std::map<double, std::vector<double>> m_Powers;
+		const std::vector<double>& Powers(double p);
+
+		void FirstLayer(double p, std::vector<double>& layer);
+		void NextLayer(const std::vector<double>& previous, unsigned int k, double p, std::vector<double>& layer);
+		// Turn the last layer into the probability of ending at or before each length
+		void Accumulate(std::vector<double>& layer) const;
+
+	public:
+		// Number of sequences per sequence length
+		SigspanEngine(const std::map<unsigned int, unsigned int>& shape);
+
+		// Length of the longest sequence and total number of symbols
+		unsigned int Length() const;
+		unsigned int DatasetSize() const;
+
+		// Occurrence probability per sequence length, entry i for length i+1
+		std::vector<double> Occurrence(const std::vector<double>& probabilities);
+		// Expected support given the occurrence probabilities
+		double ExpectedValue(const std::vector<double>& occurrence, unsigned int patternLength) const;
+		// Expected support of each pattern given its symbol probabilities
+		std::vector<double> ExpectedValues(const std::vector<std::vector<double>>& probabilities);
+};
+#endif
+#endif
@@ -0,0 +1,51 @@
+#include "StatisticsPlan.h"
+
+StatisticsPlan::StatisticsPlan():
+	support(true),
+	nonZero(true),
+	moments(true),
+	distribution(true),
+	symbolTotals(true)
+{
+}
+
+StatisticsPlan::StatisticsPlan(const std::vector<char>& columns, bool westfallYoung):
+	support(true),
+	nonZero(false),
+	moments(false),
+	distribution(westfallYoung),
+	symbolTotals(false)
+{
+	for (char column: columns){
+		switch(column){
+			case 'c':
+				nonZero = true;
+				break;
+			case 'e':
+			case 'd':
+			case 'n':
+			case 'N':
+				moments = true;
+				break;
+			case 'l':
+			case 'L':
+				moments = true;
+				nonZero = true;
+				break;
+			case 'p':
+			case 'P':
+				distribution = true;
+				break;
+			case 'b':
+			case 'i':
+			case 'I':
+				symbolTotals = true;
+				break;
+		}
+	}
+}
+
+bool StatisticsPlan::Probabilities() const
+{
+	return moments || distribution;
+}
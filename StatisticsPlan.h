@@ -0,0 +1,28 @@
+#ifndef STATISTICSPLAN_H
+#define STATISTICSPLAN_H
+
+#include <vector>
+
+// The accumulators a pass over the data maintains, derived once from the
+// requested output columns so cheap queries skip occurrence probabilities.
+struct StatisticsPlan{
+	// Occurrences of the pattern (-s)
+	bool support;
+	// Sequences containing every pattern symbol (-c)
+	bool nonZero;
+	// Expected value and variance of the support (-e, -d, -n, -l)
+	bool moments;
+	// Histogram of occurrence probabilities (-p, -W)
+	bool distribution;
+	// Per symbol totals over the data (SigSpan)
+	bool symbolTotals;
+
+	// Maintain everything
+	StatisticsPlan();
+	// Maintain what the output columns and significance tests need
+	StatisticsPlan(const std::vector<char>& columns, bool westfallYoung);
+
+	// Whether occurrence probabilities have to be computed
+	bool Probabilities() const;
+};
+#endif
@@ -0,0 +1,47 @@
+#include "SymbolTable.h"
+
+SymbolTable::SymbolTable(){
+}
+
+SymbolTable::SymbolTable(const SymbolTable& other){
+	// The views in m_Ids have to point into our own strings
+	for (auto const& name: other.m_Names){
+		Intern(name);
+	}
+}
+
+SymbolTable& SymbolTable::operator=(const SymbolTable& other){
+	if (this != &other){
+		m_Names.clear();
+		m_Ids.clear();
+		for (auto const& name: other.m_Names){
+			Intern(name);
+		}
+	}
+	return *this;
+}
+
+unsigned int SymbolTable::Intern(std::string_view symbol){
+	auto search = m_Ids.find(symbol);
+	if (search != m_Ids.end()) return search->second;
+
+	unsigned int id = m_Names.size();
+	m_Names.push_back(std::string(symbol));
+	m_Ids[m_Names.back()] = id;
+	return id;
+}
+
+bool SymbolTable::Find(std::string_view symbol, unsigned int& id) const{
+	auto search = m_Ids.find(symbol);
+	if (search == m_Ids.end()) return false;
+	id = search->second;
+	return true;
+}
+
+const std::string& SymbolTable::Name(unsigned int id) const{
+	return m_Names[id];
+}
+
+unsigned int SymbolTable::Size() const{
+	return m_Names.size();
+}
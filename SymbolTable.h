@@ -0,0 +1,31 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Interns symbols to dense integer ids
+class SymbolTable{
+	private:
+		// Owns the symbol strings, a deque keeps the views in m_Ids valid
+		std::deque<std::string> m_Names;
+		std::unordered_map<std::string_view, unsigned int> m_Ids;
+
+	public:
+		SymbolTable();
+		SymbolTable(const SymbolTable& other);
+		SymbolTable& operator=(const SymbolTable& other);
+		SymbolTable(SymbolTable&& other) = default;
+		SymbolTable& operator=(SymbolTable&& other) = default;
+
+		// Get the id of a symbol, adding it if it is new
+		unsigned int Intern(std::string_view symbol);
+		// Get the id of a known symbol, false if it was never interned
+		bool Find(std::string_view symbol, unsigned int& id) const;
+
+		const std::string& Name(unsigned int id) const;
+		unsigned int Size() const;
+};
+#endif
@@ -0,0 +1,172 @@
+#include "TokenReader.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t BUFFER_SIZE = 1 << 20;
+
+TokenReader::TokenReader(std::string filename, char symbolSeparator, char lineSeparator) :
+	m_File(-1),
+	m_SymbolSeparator(symbolSeparator),
+	m_LineSeparator(lineSeparator),
+	m_Data(nullptr),
+	m_Mapped(false),
+	m_MappedSize(0),
+	m_Ranged(false),
+	m_RangeBegin(0),
+	m_RangeEnd(0) {
+	if (filename == "-"){
+		m_File = dup(STDIN_FILENO);
+	} else {
+		m_File = open(filename.c_str(), O_RDONLY);
+	}
+
+	struct stat info;
+	if (m_File >= 0 && fstat(m_File, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+		void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, m_File, 0);
+		if (mapping != MAP_FAILED){
+			madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+			m_Data = static_cast<const char*>(mapping);
+			m_Mapped = true;
+			m_MappedSize = info.st_size;
+			m_RangeEnd = m_MappedSize;
+		}
+	}
+	Clear();
+}
+
+TokenReader::~TokenReader(){
+	if (m_Mapped) munmap(const_cast<char*>(m_Data), m_MappedSize);
+	if (m_File >= 0) close(m_File);
+}
+
+bool TokenReader::ReadMore(){
+	if (m_StreamFinished) return false;
+
+	// Move the unread part to the front and grow when a line fills the buffer
+	if (m_Begin > 0){
+		std::memmove(m_Buffer.data(), m_Buffer.data() + m_Begin, m_End - m_Begin);
+		m_End -= m_Begin;
+		m_Begin = 0;
+	}
+	if (m_End == m_Buffer.size()){
+		m_Buffer.resize(2 * m_Buffer.size());
+	}
+
+	ssize_t bytes = read(m_File, m_Buffer.data() + m_End, m_Buffer.size() - m_End);
+	while (bytes < 0 && errno == EINTR){
+		bytes = read(m_File, m_Buffer.data() + m_End, m_Buffer.size() - m_End);
+	}
+	m_Data = m_Buffer.data();
+	if (bytes <= 0){
+		m_StreamFinished = true;
+		return false;
+	}
+	m_End += bytes;
+	return true;
+}
+
+bool TokenReader::NextLine(){
+	// Find the next line holding at least one symbol, like getline skips empty lines
+	while (true){
+		size_t searched = m_Begin;
+		const char* separator = nullptr;
+		while (true){
+			separator = static_cast<const char*>(std::memchr(m_Data + searched, m_LineSeparator, m_End - searched));
+			if (separator != nullptr) break;
+			size_t offset = m_End - m_Begin;
+			if (!ReadMore()) break;
+			searched = m_Begin + offset;
+		}
+
+		if (separator != nullptr){
+			m_Position = m_Begin;
+			m_LineEnd = separator - m_Data;
+			m_Begin = m_LineEnd + 1;
+		} else if (m_Begin < m_End){
+			m_Position = m_Begin;
+			m_LineEnd = m_End;
+			m_Begin = m_End;
+		} else {
+			return false;
+		}
+
+		if (m_Position < m_LineEnd) break;
+	}
+	m_LineFinished = false;
+	return true;
+}
+
+std::string_view TokenReader::NextToken(){
+	// A trailing separator does not start an empty symbol
+	const char* start = m_Data + m_Position;
+	const char* separator = static_cast<const char*>(std::memchr(start, m_SymbolSeparator, m_LineEnd - m_Position));
+	size_t length = (separator == nullptr ? m_LineEnd - m_Position : separator - start);
+	m_Position += length + 1;
+	m_LineFinished = (m_Position >= m_LineEnd);
+	return std::string_view(start, length);
+}
+
+bool TokenReader::Item(std::string_view& itemData){
+	if (m_FileFinished){
+		return false;
+	} else if (m_LineFinished){
+		m_FileFinished = !NextLine();
+		itemData = "\n";
+	} else {
+		itemData = NextToken();
+	}
+	return true;
+}
+
+void TokenReader::Clear(){
+	if (m_Mapped){
+		m_Begin = m_RangeBegin;
+		m_End = m_RangeEnd;
+		m_StreamFinished = true;
+	} else {
+		// Rewinding only works for seekable input
+		if (m_File >= 0) lseek(m_File, 0, SEEK_SET);
+		m_Buffer.resize(BUFFER_SIZE);
+		m_Data = m_Buffer.data();
+		m_Begin = 0;
+		m_End = 0;
+		m_StreamFinished = (m_File < 0);
+	}
+	m_FileFinished = false;
+	m_LineFinished = !NextLine();
+
+	// Only a whole file without symbols reads as a single empty sequence
+	if (m_LineFinished && m_Ranged) m_FileFinished = true;
+}
+
+std::vector<size_t> TokenReader::SplitPoints(unsigned int ranges) const{
+	if (!m_Mapped) return std::vector<size_t>();
+
+	std::vector<size_t> points(1, 0);
+	for (unsigned int i = 1; i < ranges; ++i){
+		size_t point = m_MappedSize / ranges * i;
+		if (point <= points.back()) continue;
+		const char* separator = static_cast<const char*>(std::memchr(m_Data + point - 1, m_LineSeparator, m_MappedSize - point + 1));
+		if (separator == nullptr) break;
+		point = separator - m_Data + 1;
+		if (point > points.back() && point < m_MappedSize) points.push_back(point);
+	}
+	points.push_back(m_MappedSize);
+	return points;
+}
+
+bool TokenReader::SetRange(size_t begin, size_t end){
+	if (!m_Mapped) return false;
+
+	m_Ranged = true;
+	m_RangeBegin = begin;
+	m_RangeEnd = end;
+	Clear();
+	return true;
+}
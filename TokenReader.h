@@ -0,0 +1,57 @@
+#ifndef TOKENREADER_H
+#define TOKENREADER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Reads symbols from a sequence file without copying them. Regular files are
+// memory-mapped, anything else (pipes, "-" for stdin) is read through a
+// buffer that always holds at least the current line. Returned views stay
+// valid until the next sequence boundary has been returned.
+class TokenReader{
+	private:
+		int m_File;
+		char m_SymbolSeparator;
+		char m_LineSeparator;
+
+		// Data window, either the mapping or the streaming buffer
+		const char* m_Data;
+		size_t m_Begin;
+		size_t m_End;
+		bool m_Mapped;
+		size_t m_MappedSize;
+		bool m_Ranged;
+		size_t m_RangeBegin;
+		size_t m_RangeEnd;
+		std::vector<char> m_Buffer;
+		bool m_StreamFinished;
+
+		// Current line
+		size_t m_Position;
+		size_t m_LineEnd;
+		bool m_LineFinished;
+		bool m_FileFinished;
+
+		bool ReadMore();
+		bool NextLine();
+		std::string_view NextToken();
+
+	public:
+		TokenReader(std::string filename, char symbol_separator, char line_separator);
+		~TokenReader();
+		TokenReader(const TokenReader&) = delete;
+		TokenReader& operator=(const TokenReader&) = delete;
+
+		// Get the next symbol, "\n" marks the end of a sequence
+		bool Item(std::string_view& item_data);
+
+		void Clear();
+
+		// Byte offsets splitting a mapped file into at most the given number of
+		// ranges, each starting at a line, including 0 and the file size
+		std::vector<size_t> SplitPoints(unsigned int ranges) const;
+		// Only read the lines starting in [begin, end), false if not mapped
+		bool SetRange(size_t begin, size_t end);
+};
+#endif
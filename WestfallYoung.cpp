@@ -0,0 +1,111 @@
+#include "WestfallYoung.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
+
+WestfallYoung::WestfallYoung(const PatternSet& patterns, const Dataset& dataset, unsigned int threads, uint64_t seed):
+	m_Patterns(patterns),
+	m_Threads(std::max(threads, 1u)),
+	m_Seed(seed)
+{
+	for (auto const& p: patterns.Patterns()){
+		m_Lengths.push_back(p.SymbolIds().size());
+		m_Tails.push_back(p.PExactTail());
+	}
+
+	m_Offsets.push_back(0);
+	for (unsigned int i = 0; i < dataset.Sequences(); ++i){
+		for (const unsigned int* s = dataset.Begin(i); s != dataset.End(i); ++s){
+			if (!patterns.Occurrences(*s).empty()){
+				m_Symbols.push_back(*s);
+			}
+		}
+		m_Offsets.push_back(m_Symbols.size());
+	}
+}
+
+double WestfallYoung::MinP(unsigned int permutation) const
+{
+	METRIC_ADD(PERMUTATIONS, 1);
+	std::seed_seq seed{(uint32_t) m_Seed, (uint32_t) (m_Seed >> 32), (uint32_t) permutation};
+	std::mt19937_64 generator(seed);
+
+	std::vector<unsigned int> active(m_Lengths.size(), 0);
+	std::vector<unsigned int> support(m_Lengths.size(), 0);
+	std::vector<unsigned int> touched;
+	std::vector<unsigned int> sequence;
+
+	for (unsigned int i = 0; i + 1 < m_Offsets.size(); ++i){
+		sequence.assign(m_Symbols.begin() + m_Offsets[i], m_Symbols.begin() + m_Offsets[i+1]);
+		std::shuffle(sequence.begin(), sequence.end(), generator);
+
+		for (unsigned int symbol: sequence){
+			for (auto const& o: m_Patterns.Occurrences(symbol)){
+				if (active[o.first] == o.second){
+					if (o.second == 0) touched.push_back(o.first);
+					active[o.first]++;
+				}
+			}
+		}
+
+		for (unsigned int p: touched){
+			if (active[p] == m_Lengths[p]) support[p]++;
+			active[p] = 0;
+		}
+		touched.clear();
+	}
+
+	double minP = std::numeric_limits<double>::infinity();
+	for (unsigned int p = 0; p < m_Tails.size(); ++p){
+		minP = std::min(minP, m_Tails[p][support[p]]);
+	}
+	return minP;
+}
+
+std::vector<double> WestfallYoung::MinPs(unsigned int permutations) const
+{
+	std::vector<double> result(permutations);
+	std::atomic<unsigned int> next(0);
+	unsigned int done = 0;
+	std::mutex progress;
+
+	auto worker = [&](){
+		unsigned int permutation;
+		while ((permutation = next++) < permutations){
+			result[permutation] = MinP(permutation);
+
+			std::lock_guard<std::mutex> lock(progress);
+			std::cout << "\r" << "Sample " << ++done << "/" << permutations << std::flush;
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned int i = 1; i < m_Threads; ++i){
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (auto& t: pool){
+		t.join();
+	}
+	return result;
+}
+
+double WestfallYoung::Threshold(std::vector<double> minPs, double alpha)
+{
+	std::sort(minPs.begin(), minPs.end());
+
+	// Number of permutations allowed at or below the threshold, stepping
+	// down over ties so the count is not exceeded
+	unsigned int k = std::floor(alpha * minPs.size() + 1e-9);
+	while (k > 0 && k < minPs.size() && minPs[k] == minPs[k-1]){
+		--k;
+	}
+	if (k == 0) return 0;
+	return minPs[k-1];
+}
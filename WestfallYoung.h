@@ -0,0 +1,42 @@
+#ifndef WESTFALLYOUNG_H
+#define WESTFALLYOUNG_H
+
+#include "Dataset.h"
+#include "PatternSet.h"
+
+#include <cstdint>
+#include <vector>
+
+// Westfall-Young permutation test over an in-memory dataset. Every
+// permutation shuffles each sequence with its own generator seeded from
+// (seed, permutation), so results do not depend on the number of threads.
+class WestfallYoung{
+	private:
+		const PatternSet& m_Patterns;
+		std::vector<unsigned int> m_Lengths;
+
+		// Per sequence only the symbols occurring in some pattern, as the
+		// order of the other symbols does not affect any support
+		std::vector<unsigned int> m_Symbols;
+		std::vector<uint64_t> m_Offsets;
+
+		// Exact p-value of every possible support per pattern, these do not
+		// change under permutation as symbol counts stay the same
+		std::vector<std::vector<double>> m_Tails;
+
+		unsigned int m_Threads;
+		uint64_t m_Seed;
+
+		double MinP(unsigned int permutation) const;
+
+	public:
+		WestfallYoung(const PatternSet& patterns, const Dataset& dataset, unsigned int threads, uint64_t seed);
+
+		// Smallest p-value over all patterns for each permutation
+		std::vector<double> MinPs(unsigned int permutations) const;
+
+		// Largest threshold for which at most alpha of the permutations have a
+		// smaller or equal min-p, 0 if there are too few permutations
+		static double Threshold(std::vector<double> minPs, double alpha);
+};
+#endif
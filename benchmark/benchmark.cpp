@@ -0,0 +1,261 @@
+// Benchmarks of the main stages on synthetic data, written as JSON so runs of
+// different versions can be compared with compare.py. Build from the
+// repository root with
+//   g++ -std=c++17 -O2 -pthread -I. benchmark/benchmark.cpp $(ls *.cpp | grep -v main.cpp) -o bench
+// and run as
+//   ./bench [--quick] [--repetitions n] [--seed n] <results.json>
+
+#include "DataPass.h"
+#include "Dataset.h"
+#include "FileReader.h"
+#include "Pattern.h"
+#include "PatternSet.h"
+#include "StatisticsPlan.h"
+#include "TokenReader.h"
+#include "WestfallYoung.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+struct Result{
+	std::string name;
+	std::vector<std::pair<std::string, unsigned long>> parameters;
+	std::vector<double> seconds;
+	unsigned long items;
+};
+
+// Symbol n of an alphabet of m symbols, as num_to_string in helper_functions.py
+std::string numToString(unsigned int n, unsigned int m){
+	std::string s;
+	while (n > 0){
+		s = (char)('A' + n % 26) + s;
+		n /= 26;
+	}
+	unsigned int width = std::ceil(std::log(m) / std::log(26));
+	if (s.size() < width) s = std::string(width - s.size(), 'A') + s;
+	return s;
+}
+
+// Port of generate_random_dataset in helper_functions.py: sequences of the
+// given length drawn uniformly from an alphabet named after its size
+std::vector<std::vector<std::string>> generateRandomDataset(unsigned int alphabet, unsigned int sequences, unsigned int length, std::mt19937_64& rng){
+	std::vector<std::string> symbols;
+	for (unsigned int i = 0; i < alphabet; ++i){
+		symbols.push_back(std::to_string(alphabet) + numToString(i, alphabet));
+	}
+	std::uniform_int_distribution<unsigned int> pick(0, alphabet - 1);
+	std::vector<std::vector<std::string>> dataset(sequences);
+	for (auto& sequence: dataset){
+		for (unsigned int i = 0; i < length; ++i){
+			sequence.push_back(symbols[pick(rng)]);
+		}
+	}
+	return dataset;
+}
+
+// Patterns of distinct symbols of the same alphabet
+std::vector<std::vector<std::string>> generatePatterns(unsigned int alphabet, unsigned int patterns, unsigned int length, std::mt19937_64& rng){
+	std::vector<unsigned int> ids(alphabet);
+	for (unsigned int i = 0; i < alphabet; ++i) ids[i] = i;
+	std::vector<std::vector<std::string>> result(patterns);
+	for (auto& pattern: result){
+		std::shuffle(ids.begin(), ids.end(), rng);
+		for (unsigned int i = 0; i < length && i < alphabet; ++i){
+			pattern.push_back(std::to_string(alphabet) + numToString(ids[i], alphabet));
+		}
+	}
+	return result;
+}
+
+std::string writeDataset(const std::vector<std::vector<std::string>>& dataset){
+	char filename[] = "/tmp/ps2benchXXXXXX";
+	int file = mkstemp(filename);
+	close(file);
+	std::ofstream out(filename);
+	for (auto const& sequence: dataset){
+		for (unsigned int i = 0; i < sequence.size(); ++i){
+			out << (i > 0 ? " " : "") << sequence[i];
+		}
+		out << "\n";
+	}
+	return filename;
+}
+
+// Time a function, after one warm up call, and keep every repetition
+Result measure(std::string name, std::vector<std::pair<std::string, unsigned long>> parameters, unsigned long items, unsigned int repetitions, std::function<void()> setup, std::function<void()> run){
+	Result result{name, parameters, {}, items};
+	setup();
+	run();
+	for (unsigned int r = 0; r < repetitions; ++r){
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		run();
+		result.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(result.seconds.begin(), result.seconds.end());
+	std::cerr << name;
+	for (auto const& p: parameters) std::cerr << " " << p.first << "=" << p.second;
+	std::cerr << ": " << result.seconds[result.seconds.size() / 2] << "s" << std::endl;
+	return result;
+}
+
+void clearCaches(){
+	Pattern::TakeCache();
+}
+
+int main(int argc, char** argv)
+{
+	bool quick = false;
+	unsigned long repetitions = 5;
+	unsigned long seed = 0;
+	std::string output;
+	for (int i = 1; i < argc; ++i){
+		if (std::strcmp(argv[i], "--quick") == 0){
+			quick = true;
+		} else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc){
+			repetitions = std::max(std::strtoul(argv[++i], nullptr, 10), 1ul);
+		} else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+			seed = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			output = argv[i];
+		}
+	}
+	if (output.empty()){
+		std::cout << argv[0] << " [--quick] [--repetitions n] [--seed n] <results.json>" << std::endl;
+		return 0;
+	}
+	unsigned int scale = (quick ? 10 : 1);
+	std::mt19937_64 rng(seed);
+	std::vector<Result> results;
+	StatisticsPlan plan;
+
+	// Tokenization
+	{
+		unsigned int alphabet = 50, sequences = 20000 / scale, length = 100;
+		std::string data = writeDataset(generateRandomDataset(alphabet, sequences, length, rng));
+		std::vector<std::pair<std::string, unsigned long>> parameters = {{"alphabet", alphabet}, {"sequences", sequences}, {"length", length}};
+		unsigned long items = (unsigned long)sequences * length;
+		results.push_back(measure("tokenize/FileReader", parameters, items, repetitions, [](){}, [&](){
+			FileReader reader(data, ' ', '\n', false);
+			std::string item;
+			while (reader.Item(item));
+		}));
+		results.push_back(measure("tokenize/TokenReader", parameters, items, repetitions, [](){}, [&](){
+			TokenReader reader(data, ' ', '\n');
+			std::string_view item;
+			while (reader.Item(item));
+		}));
+		std::remove(data.c_str());
+	}
+
+	// Passes over the data
+	for (unsigned int patternLength: {2u, 4u, 6u}){
+		unsigned int alphabet = 50, sequences = 5000 / scale, length = 50, patternCount = 1000 / scale;
+		std::string data = writeDataset(generateRandomDataset(alphabet, sequences, length, rng));
+		std::vector<std::vector<std::string>> patternSymbols = generatePatterns(alphabet, patternCount, patternLength, rng);
+		std::vector<std::pair<std::string, unsigned long>> parameters = {{"alphabet", alphabet}, {"sequences", sequences}, {"length", length}, {"patterns", patternCount}, {"pattern_length", patternLength}};
+		results.push_back(measure("applyFileToPatterns", parameters, (unsigned long)sequences * length, repetitions, clearCaches, [&](){
+			PatternSet patterns(0);
+			for (auto const& p: patternSymbols) patterns.Add(p);
+			TokenReader reader(data, ' ', '\n');
+			applyFileToPatterns(&patterns, &reader, plan, 0);
+		}));
+		std::remove(data.c_str());
+	}
+
+	// Permutation probabilities of single count vectors, without memoization
+	Pattern::SetFixedKernels(false);
+	PrefixCache::SetBudget(0);
+	for (Pattern::CMethod method: {Pattern::C_BIGINT, Pattern::C_LOG, Pattern::C_PREFIX}){
+		Pattern::SetCMethod(method);
+		for (unsigned int symbols: {3u, 5u, 8u}){
+			for (unsigned int total: {20u, 60u, 120u}){
+				if (method == Pattern::C_BIGINT && total > 60 && symbols > 5) continue;
+				SymbolTable table;
+				std::vector<std::string> patternSymbols;
+				for (unsigned int i = 0; i < symbols; ++i) patternSymbols.push_back("s" + std::to_string(i));
+				Pattern pattern(patternSymbols, table);
+
+				// Counts split evenly, the harder case for the recursion
+				std::vector<unsigned int> counts(table.Size(), total / symbols);
+				for (unsigned int i = 0; i < total % symbols; ++i) counts[i]++;
+				std::string name = (method == Pattern::C_LOG ? "C/log" : (method == Pattern::C_PREFIX ? "C/prefix" : "C/bigint"));
+				results.push_back(measure(name, {{"symbols", symbols}, {"total", total}}, 1, repetitions, clearCaches, [&](){
+					pattern.SequenceSeen(symbols, counts, plan);
+					pattern.Process(plan);
+					pattern.Clear();
+				}));
+			}
+		}
+	}
+	Pattern::SetCMethod(Pattern::C_BIGINT);
+	Pattern::SetFixedKernels(true);
+	PrefixCache::SetBudget(64 << 20);
+
+	// Exact p-values over growing numbers of sequences
+	for (unsigned int sequences: {100u / scale, 1000u / scale, 10000u / scale}){
+		SymbolTable table;
+		Pattern pattern({"a", "b", "c"}, table);
+		std::uniform_int_distribution<unsigned int> count(1, 8);
+		for (unsigned int i = 0; i < sequences; ++i){
+			std::vector<unsigned int> counts = {count(rng), count(rng), count(rng)};
+			pattern.SequenceSeen(3, counts, plan);
+			pattern.Process(plan);
+			pattern.Clear();
+		}
+		results.push_back(measure("PExact", {{"sequences", sequences}}, 1, repetitions, [](){}, [&](){
+			volatile double p = pattern.PExact();
+			(void)p;
+		}));
+	}
+
+	// Westfall-Young permutations on one thread
+	{
+		unsigned int alphabet = 20, sequences = 1000 / scale, length = 50, patternCount = 200, permutations = 20;
+		std::vector<std::vector<std::string>> dataset = generateRandomDataset(alphabet, sequences, length, rng);
+		std::string data = writeDataset(dataset);
+		PatternSet patterns(0);
+		for (auto const& p: generatePatterns(alphabet, patternCount, 3, rng)) patterns.Add(p);
+		TokenReader reader(data, ' ', '\n');
+		Dataset loaded(reader, patterns.Symbols());
+		applyDatasetToPatterns(&patterns, &loaded, plan, 0);
+		std::remove(data.c_str());
+
+		std::streambuf* progress = std::cout.rdbuf(nullptr);
+		results.push_back(measure("WestfallYoung", {{"alphabet", alphabet}, {"sequences", sequences}, {"length", length}, {"patterns", patternCount}, {"permutations", permutations}}, permutations, repetitions, [](){}, [&](){
+			WestfallYoung westfallYoung(patterns, loaded, 1, 0);
+			westfallYoung.MinPs(permutations);
+		}));
+		std::cout.rdbuf(progress);
+	}
+
+	// One benchmark per line, so result files can also be compared with diff
+	std::ofstream out(output);
+	out << "{\"version\": 1, \"seed\": " << seed << ", \"repetitions\": " << repetitions << ", \"benchmarks\": [" << std::endl;
+	out << std::setprecision(6);
+	for (unsigned int i = 0; i < results.size(); ++i){
+		const Result& r = results[i];
+		double median = r.seconds[r.seconds.size() / 2];
+		out << "{\"name\": \"" << r.name << "\", \"parameters\": {";
+		for (unsigned int k = 0; k < r.parameters.size(); ++k){
+			out << (k > 0 ? ", " : "") << "\"" << r.parameters[k].first << "\": " << r.parameters[k].second;
+		}
+		out << "}, \"seconds\": " << median << ", \"min_seconds\": " << r.seconds.front() << ", \"max_seconds\": " << r.seconds.back()
+			<< ", \"items_per_second\": " << r.items / median << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	out << "]}" << std::endl;
+	return 0;
+}
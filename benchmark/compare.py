@@ -0,0 +1,43 @@
+#!/usr/bin/python3
+
+"""
+Compare two result files of the benchmark, e.g. of the previous and the
+current version, and report the ratio of the median times.
+
+Usage: python3 compare.py <old.json> <new.json> [--threshold 1.1]
+Exits with 1 if any benchmark became slower than the threshold ratio.
+"""
+
+import json
+import sys
+
+args = sys.argv[1:]
+threshold = None
+if "--threshold" in args:
+	i = args.index("--threshold")
+	threshold = float(args[i + 1])
+	del args[i:i + 2]
+if len(args) != 2:
+	print(__doc__)
+	sys.exit(1)
+
+def load(filename):
+	with open(filename) as f:
+		results = json.load(f)['benchmarks']
+	return {(r['name'], json.dumps(r['parameters'], sort_keys=True)): r for r in results}
+
+old, new = load(args[0]), load(args[1])
+slower = 0
+print("{:<24} {:<60} {:>10} {:>10} {:>7}".format("benchmark", "parameters", "old (s)", "new (s)", "ratio"))
+for key in sorted(new):
+	if key not in old:
+		continue
+	ratio = new[key]['seconds'] / old[key]['seconds']
+	flag = ""
+	if threshold is not None and ratio > threshold:
+		flag = " slower"
+		slower += 1
+	print("{:<24} {:<60} {:>10.4g} {:>10.4g} {:>7.3f}{}".format(key[0], key[1], old[key]['seconds'], new[key]['seconds'], ratio, flag))
+for key in sorted(set(old) ^ set(new)):
+	print("{:<24} {:<60} only in {}".format(key[0], key[1], args[0] if key in old else args[1]))
+sys.exit(1 if slower > 0 else 0)
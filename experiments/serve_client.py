@@ -0,0 +1,57 @@
+#!/usr/bin/python3
+
+"""
+Send a pattern file to a running `p serve --socket <path> <data>` and print
+the result lines, which match those of `p <options> <data> <patterns>`.
+With --clients n the request is sent by n clients at once, which the server
+scores in shared passes, and their responses are checked to be equal.
+
+Usage: python3 serve_client.py <socket> <patterns> [--clients n] [options]
+e.g.   python3 serve_client.py /tmp/ps2.sock patterns.txt --clients 8 -s -e -p
+"""
+
+import socket
+import sys
+import threading
+
+def request(path, options, patterns):
+	message = " ".join(options) + "\n" + "".join(p + "\n" for p in patterns) + "\n"
+	with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+		client.connect(path)
+		client.sendall(message.encode())
+		client.shutdown(socket.SHUT_WR)
+		response = b""
+		while not response.endswith(b"\n\n") and not response == b"\n":
+			data = client.recv(1 << 16)
+			if not data:
+				break
+			response += data
+	return response.decode()
+
+args = sys.argv[1:]
+if len(args) < 2:
+	print(__doc__)
+	sys.exit(1)
+path, pattern_file, options = args[0], args[1], args[2:]
+clients = 1
+if "--clients" in options:
+	i = options.index("--clients")
+	clients = int(options[i + 1])
+	del options[i:i + 2]
+
+with open(pattern_file) as f:
+	patterns = [line.rstrip("\n") for line in f if line.strip("\n")]
+
+responses = [None] * clients
+def run(i):
+	responses[i] = request(path, options, patterns)
+threads = [threading.Thread(target=run, args=(i,)) for i in range(clients)]
+for t in threads:
+	t.start()
+for t in threads:
+	t.join()
+
+if any(r != responses[0] for r in responses):
+	print("responses differ between clients")
+	sys.exit(1)
+sys.stdout.write(responses[0].rstrip("\n") + "\n")
@@ -0,0 +1,28 @@
+#!/usr/bin/python3
+
+"""
+Compare the output of `p validate-c <max length> <max count> [method]` or
+`p validate-c-data <data> <patterns> [method]` with the reference
+implementation C_i in helper_functions.
+
+Usage: ../p validate-c 4 6 prefix | python3 validate_C.py prefix
+"""
+
+from helper_functions import C_i
+import sys
+
+method = sys.argv[1] if len(sys.argv) > 1 else 'log'
+max_error = {'bigint': 0.0, method: 0.0}
+for line in sys.stdin:
+	if ":" not in line:
+		continue
+	counts, values = line.split(":")
+	X = [int(x) for x in counts.split()]
+	bigint, other = [float(v) for v in values.split()[:2]]
+
+	reference = C_i(X)
+	max_error['bigint'] = max(max_error['bigint'], abs(bigint - reference) / reference)
+	max_error[method] = max(max_error[method], abs(other - reference) / reference)
+
+print("max relative error to C_i (bigint) = {}".format(max_error['bigint']))
+print("max relative error to C_i ({}) = {}".format(method, max_error[method]))
@@ -1,53 +1,227 @@
+#include "CCache.h"
+#include "Checkpoint.h"
+#include "DataPass.h"
+#include "Dataset.h"
 #include "FileReader.h"
+#include "Metrics.h"
 #include "Pattern.h"
+#include "PatternSet.h"
+#include "ResultFilter.h"
+#include "Sample.h"
+#include "Server.h"
+#include "StatisticsPlan.h"
+#include "TokenReader.h"
+#include "WestfallYoung.h"
 
+#include <csignal>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <numeric>
 #include <string>
+#include <thread>
 #include <vector>
 
-std::map<unsigned int, unsigned int> applyFileToPatterns(std::vector<Pattern>* patterns, FileReader* sequenceFile, bool onlyCount, unsigned int verbose){
-	// Iterate sequences
-	std::map<unsigned int, unsigned int> databaseShape;
-	#ifdef SIGSPAN
-	unsigned int sequenceLength = 0;
+// Options selecting output columns
+#ifdef SIGSPAN
+static const std::string COLUMNS = "secdnNpPlLbiI";
+#else
+static const std::string COLUMNS = "secdnNpPlL";
+#endif
+
+std::string formatResult(const Pattern& p, const std::vector<char>& columns, [[maybe_unused]] const std::map<unsigned int, unsigned int>& databaseShape){
+	// The requested columns followed by the pattern, empty without columns
+	std::ostringstream resultString;
+
+	// P-values estimated from a sample are followed by their 95% confidence
+	// interval, taken at the ends of the interval of the support
+	std::vector<Pattern> bounds;
+	if (p.Sampled()){
+		std::pair<Pattern, Pattern> support = p.SupportInterval();
+		bounds = {support.second, support.first};
+	}
+	auto interval = [&](double (Pattern::*pValue)() const, bool logarithm){
+		if (bounds.empty()) return std::string();
+		double low = (bounds[0].*pValue)();
+		double high = (bounds[1].*pValue)();
+		std::ostringstream result;
+		if (logarithm){
+			result << "[" << -log(high) << "," << -log(low) << "] ";
+		} else {
+			result << "[" << low << "," << high << "] ";
+		}
+		return result.str();
+	};
+
+	// With --p-auto the exact p-value columns take the cheapest method within
+	// the tolerance
+	bool automatic = Pattern::PTolerance() > 0;
+	double (Pattern::*pExact)() const = (automatic ? &Pattern::PAuto : &Pattern::PExact);
+
+	for (char column: columns){
+		switch(column){
+			case 's':
+				resultString << p.Support() << " ";
+				break;
+			case 'e':
+				resultString << p.ExpectedValue() << " ";
+				break;
+			case 'd':
+				resultString << p.StandardDeviation() << " ";
+				break;
+			case 'c':
+				resultString << p.NonZeroSequences() << " ";
+				break;
+			case 'n':
+				resultString << p.PNormal() << " " << interval(&Pattern::PNormal, false);
+				break;
+			case 'N':
+				resultString << -log(p.PNormal()) << " " << interval(&Pattern::PNormal, true);
+				break;
+			case 'p':
+				resultString << (p.*pExact)() << " " << interval(pExact, false);
+				break;
+			case 'P':
+				resultString << (automatic ? -p.LogPAuto() : -log(p.PExact())) << " " << interval(pExact, true);
+				break;
+			case 'l':
+				resultString << p.PPoisson() << " " << interval(&Pattern::PPoisson, false);
+				break;
+			case 'L':
+				resultString << -log(p.PPoisson()) << " " << interval(&Pattern::PPoisson, true);
+				break;
+		#ifdef SIGSPAN
+			case 'b':
+				resultString << p.ExpectedValueSigspan(databaseShape) << " ";
+				break;
+			case 'i':
+				resultString << p.PSigspan(databaseShape) << " ";
+				break;
+			case 'I':
+				resultString << -log(p.PSigspan(databaseShape)) << " ";
+				break;
+		#endif
+		}
+	}
+	if (resultString.str() == "") return "";
+	return resultString.str() + p.ToString();
+}
+
+// Write the results of the patterns, numbered from first, that pass the
+// filter. For the top k the patterns with the smallest bound go first, so
+// the others can be skipped on their bound.
+void writeResults(const std::vector<Pattern>& patterns, unsigned int first, const std::vector<char>& columns, const std::map<unsigned int, unsigned int>& databaseShape,
+		ResultFilter& filter, std::ostream& out_stream){
+	std::vector<unsigned int> order(patterns.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (filter.TopK()){
+		std::vector<double> bounds(patterns.size());
+		for (unsigned int i = 0; i < patterns.size(); ++i){
+			bounds[i] = patterns[i].LogPLowerBound();
+		}
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+			return bounds[a] < bounds[b];
+		});
+	}
+	for (unsigned int i: order){
+		double logP = 0;
+		if (!filter.Admit(patterns[i], first + i, logP)) continue;
+		filter.Keep(logP, first + i, formatResult(patterns[i], columns, databaseShape), out_stream);
+	}
+}
+
+// Write the metrics and the new permutation probabilities at the end of a run
+void finishRun([[maybe_unused]] const std::string& metricsFilename, const std::string& cacheFilename){
+	#ifdef METRICS
+	if (!metricsFilename.empty() && !Metrics::Write(metricsFilename)){
+		std::cout << "Could not write metrics to " << metricsFilename << std::endl;
+	}
 	#endif
 
-	unsigned int sequenceCounter = 0;
-	std::string newItem;
-	while (sequenceFile->Item(newItem)){
-		if (newItem == "\n"){
-			if (verbose >= 2) std::cout << std::endl;
-			sequenceCounter++;
+	if (!cacheFilename.empty() && !CCache::Save(cacheFilename, Pattern::CMethodId(), Pattern::TakeCache().C)){
+		std::cout << "Could not write C cache " << cacheFilename << std::endl;
+	}
+}
 
-			#ifdef SIGSPAN
-			if (databaseShape.find(sequenceLength) == databaseShape.end()){
-				databaseShape[sequenceLength] = 0;
-			}
-			databaseShape[sequenceLength]++;
-			sequenceLength = 0;
-			#endif
+// Read the patterns in blocks of about memoryLimit bytes and score each block
+// in its own pass over the data, which is kept in memory. Results are written
+// in pattern file order.
+void scoreInBlocks(PatternSet& patterns, Dataset& dataset, bool compiled, const char* dataFilename, const char* patternFilename, size_t memoryLimit,
+		const StatisticsPlan& plan, const std::vector<char>& columns, double tBonferroni, bool onlySignificant, unsigned int topK,
+		unsigned int threads, unsigned int verbose, std::ofstream& outputFile){
+	if (!compiled){
+		METRIC_PHASE("load_data");
+		TokenReader sequenceFile(dataFilename, ' ', '\n');
+		dataset = Dataset(sequenceFile, patterns.Symbols());
+	}
+	std::map<unsigned int, unsigned int> databaseShape = dataset.Shape();
 
-			for (auto& p: *patterns){
-				p.Process(onlyCount);
-				p.Clear();
-			}
-			if (verbose == 1) std::cout << "\r" << sequenceCounter << " sequences processed." << std::flush;
-		} else {
-			#ifdef SIGSPAN
-			sequenceLength++;
-			#endif
+	double threshold = 1;
+	if (tBonferroni != 0){
+		// The correction needs the number of patterns before any result
+		FileReader countFile = FileReader(patternFilename, ' ', '\n', false);
+		std::vector<std::string> line;
+		unsigned int count = 0;
+		while (countFile.Line(line)) count++;
+		if (onlySignificant) threshold = tBonferroni / count;
+		std::cout << "Bonferroni significance:" << std::endl;
+		std::cout << "  B(" << tBonferroni << ") = " << tBonferroni / count << std::endl;
+		std::cout << "  -log(B(" << tBonferroni << ")) = " << -log(tBonferroni / count) << std::endl;
+		std::cout << std::endl;
+	}
 
-			if (verbose >= 2) std::cout << newItem << " ";
-			for (auto& p: *patterns){
-				p.SymbolSeen(newItem, onlyCount);
-			}
+	// Bounds on the histograms each block fills during its pass
+	std::vector<unsigned int> symbolSequences;
+	std::vector<unsigned int> symbolMaxCounts;
+	dataset.SymbolStatistics(patterns.Symbols().Size(), symbolSequences, symbolMaxCounts);
+
+	std::ostream& out_stream = (outputFile.is_open() ? outputFile : std::cout);
+	ResultFilter filter(threshold, topK);
+	FileReader patternFile = FileReader(patternFilename, ' ', '\n', false);
+	std::vector<std::string> newSymbol;
+	unsigned int blocks = 0;
+	unsigned int total = 0;
+	bool more = true;
+	while (more){
+		// Every block starts from the symbols of the data
+		METRIC_PHASE("load_patterns");
+		PatternSet block(patterns.Symbols(), verbose);
+		block.BoundHistograms(symbolSequences, symbolMaxCounts, plan.distribution, Pattern::Deferred());
+		while (block.EstimatedBytes() < memoryLimit && (more = patternFile.Line(newSymbol))){
+			block.Add(newSymbol);
 		}
+		if (block.Size() == 0) break;
+
+		METRIC_PHASE("pass");
+		if (threads > 1 && verbose < 2){
+			applyDatasetToPatternsParallel(&block, &dataset, plan, threads, verbose);
+		} else {
+			applyDatasetToPatterns(&block, &dataset, plan, verbose);
+		}
+		if (Pattern::Deferred()) evaluateDeferred(&block, plan, threads, verbose);
+
+		METRIC_PHASE("output");
+		#ifdef SIGSPAN
+		if (plan.symbolTotals) block.ComputeSigspan(databaseShape);
+		#endif
+		writeResults(block.Patterns(), total, columns, databaseShape, filter, out_stream);
+		blocks++;
+		total += block.Size();
 	}
-	if (verbose >= 1) std::cout << std::endl;
+	filter.Flush(out_stream);
+	if (verbose >= 1) std::cout << total << " patterns scored in " << blocks << " blocks." << std::endl;
+	if (filter.Active()) filter.Report(std::cout);
+	if (outputFile.is_open()){
+		outputFile.close();
+	}
+}
 
-	return databaseShape;
+bool toUnsigned(char* s, unsigned long &result) {
+	char* end;
+	result = std::strtoul(s, &end, 10);
+	if (end == s || *end != '\0' || s[0] == '-')
+		return false;
+	return true;
 }
 
 bool toDouble(char* s, double &result) {
@@ -60,8 +234,161 @@ bool toDouble(char* s, double &result) {
 
 int main(int argc, char** argv)
 {
+	if ((argc == 4 || argc == 5) && std::strcmp(argv[1], "validate-c") == 0){
+		// Compare a permutation probability method to BigInt on small count vectors
+		double maxLength, maxCount;
+		Pattern::CMethod method = Pattern::C_LOG;
+		if (!toDouble(argv[2], maxLength) || !toDouble(argv[3], maxCount) || maxLength < 2 || maxCount < 1
+				|| (argc == 5 && !Pattern::ParseCMethod(argv[4], method))){
+			std::cout << "validate-c <max length> <max count> [log|prefix], e.g. validate-c 4 6" << std::endl;
+			return 0;
+		}
+		double maxError = Pattern::ValidateC(maxLength, maxCount, method, std::cout);
+		std::cout << "max relative error = " << maxError << std::endl;
+		return 0;
+	}
+
+	if ((argc == 4 || argc == 5) && std::strcmp(argv[1], "validate-c-data") == 0){
+		// Compare a method to BigInt on the count vectors the data gives the patterns
+		Pattern::CMethod method = Pattern::C_LOG;
+		if (argc == 5 && !Pattern::ParseCMethod(argv[4], method)){
+			std::cout << "validate-c-data <data> <patterns> [log|prefix], e.g. validate-c-data data.txt patterns.txt prefix" << std::endl;
+			return 0;
+		}
+		PatternSet patterns(0);
+		Dataset dataset;
+		if (Dataset::IsCompiled(argv[2])){
+			if (!dataset.Load(argv[2], patterns.Symbols())){
+				std::cout << argv[2] << " is not a valid compiled dataset, compile it again" << std::endl;
+				return 0;
+			}
+		} else {
+			TokenReader reader(argv[2], ' ', '\n');
+			dataset = Dataset(reader, patterns.Symbols());
+		}
+		FileReader patternFile = FileReader(argv[3], ' ', '\n', false);
+		std::vector<std::string> newSymbol;
+		while (patternFile.Line(newSymbol)){
+			patterns.Add(newSymbol);
+		}
+
+		// Every count vector passes through the BigInt memo without the kernels
+		Pattern::SetFixedKernels(false);
+		applyDatasetToPatterns(&patterns, &dataset, StatisticsPlan(), 0);
+		double maxError = Pattern::ValidateC(Pattern::TakeCache().C, method, std::cout);
+		std::cout << "max relative error = " << maxError << std::endl;
+		return 0;
+	}
+
+	if ((argc == 5 || argc == 6) && std::strcmp(argv[1], "precompute-c") == 0){
+		// Fill a cache file with the permutation probabilities of small count vectors
+		double maxLength, maxCount;
+		if (!toDouble(argv[2], maxLength) || !toDouble(argv[3], maxCount) || maxLength < 2 || maxCount < 1){
+			std::cout << "precompute-c <max length> <max count> <cache> [bigint|log|prefix], e.g. precompute-c 5 20 c.cache" << std::endl;
+			return 0;
+		}
+		Pattern::CMethod method = Pattern::C_BIGINT;
+		if (argc == 6 && !Pattern::ParseCMethod(argv[5], method)){
+			std::cout << argv[5] << " is not a valid method, use bigint, log or prefix" << std::endl;
+			return 0;
+		}
+		Pattern::SetCMethod(method);
+		Pattern::SetFixedKernels(argc == 5);
+		CCache stored;
+		if (!stored.Open(argv[4], Pattern::CMethodId())){
+			std::cout << argv[4] << " is not a C cache of this version and method" << std::endl;
+			return 0;
+		}
+		Pattern::SetStoredC(&stored);
+		Pattern::PrecomputeC(maxLength, maxCount);
+		std::map<std::vector<unsigned int>, double> computed = Pattern::TakeCache().C;
+		if (!CCache::Save(argv[4], Pattern::CMethodId(), computed)){
+			std::cout << "Could not write C cache " << argv[4] << std::endl;
+			return 0;
+		}
+		std::cout << computed.size() << " values added to the " << stored.Size() << " stored in " << argv[4] << std::endl;
+		return 0;
+	}
+
+	if (argc >= 3 && std::strcmp(argv[1], "serve") == 0){
+		// Keep the data in memory and score pattern batches sent by clients
+		unsigned long threads = std::max(std::thread::hardware_concurrency(), 1u);
+		unsigned int verbose = 0;
+		std::string socketPath;
+		for (int i = 2; i < argc - 1; ++i){
+			if (std::strcmp(argv[i], "--socket") == 0 && i + 2 < argc){
+				socketPath = argv[++i];
+			} else if (std::strcmp(argv[i], "-j") == 0 && i + 2 < argc && toUnsigned(argv[i+1], threads) && threads > 0){
+				++i;
+			} else if (std::strcmp(argv[i], "-v") == 0){
+				verbose = 1;
+			} else {
+				std::cout << "serve [-v] [-j <threads>] [--socket <path>] <data>, e.g. serve -j 8 --socket /tmp/ps2.sock data.txt" << std::endl;
+				return 0;
+			}
+		}
+
+		SymbolTable symbols;
+		Dataset dataset;
+		if (Dataset::IsCompiled(argv[argc - 1])){
+			if (!dataset.Load(argv[argc - 1], symbols)){
+				std::cout << argv[argc - 1] << " is not a valid compiled dataset, compile it again" << std::endl;
+				return 0;
+			}
+		} else {
+			TokenReader reader(argv[argc - 1], ' ', '\n');
+			dataset = Dataset(reader, symbols);
+		}
+		std::map<unsigned int, unsigned int> databaseShape = dataset.Shape();
+		if (verbose >= 1) std::cerr << dataset.Sequences() << " sequences loaded." << std::endl;
+
+		Server server(symbols,
+			[&](PatternSet& patterns, const StatisticsPlan& plan){
+				if (threads > 1){
+					applyDatasetToPatternsParallel(&patterns, &dataset, plan, threads, 0);
+				} else {
+					applyDatasetToPatterns(&patterns, &dataset, plan, 0);
+				}
+				#ifdef SIGSPAN
+				if (plan.symbolTotals) patterns.ComputeSigspan(databaseShape);
+				#endif
+			},
+			[&](const Pattern& p, const std::vector<char>& columns){
+				return formatResult(p, columns, databaseShape);
+			},
+			COLUMNS, verbose);
+		std::signal(SIGPIPE, SIG_IGN);
+		if (socketPath.empty()){
+			server.ServeStdio();
+		} else if (!server.ServeSocket(socketPath)){
+			std::cout << "Could not listen on " << socketPath << std::endl;
+		}
+		return 0;
+	}
+
+	if (argc == 4 && std::strcmp(argv[1], "compile") == 0){
+		// Tokenize a sequence file once so later runs can map it directly
+		SymbolTable symbols;
+		TokenReader reader(argv[2], ' ', '\n');
+		Dataset dataset(reader, symbols);
+		if (!dataset.Write(argv[3], symbols)){
+			std::cout << "Could not write compiled dataset to " << argv[3] << std::endl;
+			return 0;
+		}
+		std::cout << dataset.Sequences() << " sequences with " << symbols.Size() << " distinct symbols compiled to " << argv[3] << std::endl;
+		return 0;
+	}
+
 	if (argc < 3) {
 		std::cout << argv[0] << " [options] <data> <patterns>" << std::endl;
+		std::cout << "Use - as <data> to read sequences from stdin." << std::endl;
+		std::cout << "Data compiled with the compile command is detected and mapped directly." << std::endl;
+		std::cout << argv[0] << " compile <data> <compiled data>" << std::endl;
+		std::cout << argv[0] << " serve [-v] [-j <threads>] [--socket <path>] <data>" << std::endl;
+		std::cout << "  Answer requests on stdin or a Unix socket: a line of output options, pattern lines, an empty line." << std::endl;
+		std::cout << argv[0] << " validate-c <max length> <max count> [log|prefix]" << std::endl;
+		std::cout << argv[0] << " validate-c-data <data> <patterns> [log|prefix]" << std::endl;
+		std::cout << argv[0] << " precompute-c <max length> <max count> <cache> [bigint|log|prefix], without a method for the default with kernels" << std::endl;
 		std::cout << "output options:" << std::endl;
 		std::cout << " -o <filename> output result to file instead of stdio" << std::endl;
 		std::cout << " -v Verbose" << std::endl;
@@ -78,9 +405,30 @@ int main(int argc, char** argv)
 		std::cout << " -N Output -log(p-value) (normal approximation)" << std::endl;
 		std::cout << " -l Output p-value (Poisson approximation)" << std::endl;
 		std::cout << " -L Output -log(p-value) (Poisson approximation)" << std::endl;
+		std::cout << " --p-auto <tolerance> Compute -p and -P exactly or by a normal, saddle-point or Poisson approximation whose error bound is within the tolerance" << std::endl;
+		std::cout << " --c-method <bigint|log|prefix> Exact prime-factor, log-space or prefix-sum occurrence probabilities, by default patterns of 2 to 4 symbols use double precision kernels" << std::endl;
+		std::cout << " --no-c-kernels Use the generic occurrence probability method for patterns of 2 to 4 symbols too" << std::endl;
+		std::cout << " --c-cache <filename> Read permutation probabilities from a cache file and add the new ones at exit" << std::endl;
+		std::cout << " --deferred-c Only record count vectors during the pass, then evaluate the distinct ones on all threads" << std::endl;
+		std::cout << " --c-prefix-cache <MB> Memory per thread for resumable occurrence probability states (default 64)" << std::endl;
 		std::cout << "Significance options:" << std::endl;
 		std::cout << " -B <alpha> Bonferroni significance threshold" << std::endl;
 		std::cout << " -W <alpha> Westfall-Young significance threshold (PS²)" << std::endl;
+		std::cout << " -R <n> Number of Westfall-Young permutations (default 100)" << std::endl;
+		std::cout << " --only-significant Only output patterns within the -W threshold, or the -B one without -W" << std::endl;
+		std::cout << " --top-k <k> Only output the k patterns with the smallest p-value, most significant first" << std::endl;
+		std::cout << " --seed <n> Seed for the Westfall-Young permutations and --sample (default 0)" << std::endl;
+		std::cout << "Performance options:" << std::endl;
+		std::cout << " -j <threads> Load text data and score it with this many threads, by default it is streamed by one thread while data in memory uses all cores" << std::endl;
+		#ifdef METRICS
+		std::cout << " --metrics <filename> Write counters, phase times and peak memory as JSON" << std::endl;
+		#endif
+		std::cout << " --mem-limit <MB> Read the patterns in blocks of at most about this much memory including their probability histograms, with a pass over the data in memory per block" << std::endl;
+		std::cout << " --chunks <n> Stream n byte ranges of the data in parallel instead of loading it, expected values and variances equal a single pass up to rounding" << std::endl;
+		std::cout << " --checkpoint <filename> Continue the sums stored in a checkpoint with the lines appended to the data since, then update it" << std::endl;
+		std::cout << " --verify-checkpoint Compare the continued sums with a full run over the data" << std::endl;
+		std::cout << " --sample <n> Score a uniform sample of n sequences, scaled to the whole data, with 95% confidence intervals after each p-value" << std::endl;
+		std::cout << " --sample-error <e> Sample enough sequences to estimate the fraction supporting a pattern within e" << std::endl;
 		#ifdef SIGSPAN
 		std::cout << "SigSpan options:" << std::endl;
 		std::cout << " -b Output expected value" <<std::endl;
@@ -94,10 +442,162 @@ int main(int argc, char** argv)
 	std::ofstream outputFile;
 	double tBonferroni = 0;
 	double tWestfallYoung = 0;
+	unsigned long permutations = 100;
+	unsigned long seed = 0;
+	unsigned long sampleSize = 0;
+	size_t memoryLimit = 0;
+	bool onlySignificant = false;
+	unsigned long topK = 0;
+	bool deferred = false;
+	unsigned long chunks = 0;
+	// 0 until -j is given, text data is then streamed by a single thread
+	unsigned long threads = 0;
+	std::vector<char> columns;
+	std::string cacheFilename;
+	std::string checkpointFilename;
+	bool verifyCheckpoint = false;
+	std::string metricsFilename;
 
 	for (unsigned int i = 1; i <= argc-3; ++i){
+		if (std::strcmp(argv[i], "--c-method") == 0){
+			Pattern::CMethod method;
+			if (!Pattern::ParseCMethod(argv[i+1], method)){
+				std::cout << "--c-method " << argv[i+1] << " is not a valid method, use bigint, log or prefix" << std::endl;
+				return 0;
+			}
+			// An explicitly chosen method also applies to 2 to 4 symbols
+			Pattern::SetCMethod(method);
+			Pattern::SetFixedKernels(false);
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--deferred-c") == 0){
+			deferred = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--no-c-kernels") == 0){
+			Pattern::SetFixedKernels(false);
+			continue;
+		}
+		if (std::strcmp(argv[i], "--checkpoint") == 0){
+			checkpointFilename = argv[i+1];
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--verify-checkpoint") == 0){
+			verifyCheckpoint = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--metrics") == 0){
+			#ifdef METRICS
+			metricsFilename = argv[i+1];
+			i += 1;
+			continue;
+			#else
+			std::cout << "--metrics needs a build with -DMETRICS" << std::endl;
+			return 0;
+			#endif
+		}
+		if (std::strcmp(argv[i], "--c-cache") == 0){
+			cacheFilename = argv[i+1];
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--c-prefix-cache") == 0){
+			unsigned long megabytes;
+			if (!toUnsigned(argv[i+1], megabytes)){
+				std::cout << "--c-prefix-cache " << argv[i+1] << " does not define a valid size in MB, use e.g. --c-prefix-cache 256" << std::endl;
+				return 0;
+			}
+			PrefixCache::SetBudget(megabytes << 20);
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--only-significant") == 0){
+			onlySignificant = true;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--top-k") == 0){
+			if (!toUnsigned(argv[i+1], topK) || topK == 0){
+				std::cout << "--top-k " << argv[i+1] << " does not define a valid number of patterns, use e.g. --top-k 100" << std::endl;
+				return 0;
+			}
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--mem-limit") == 0){
+			unsigned long megabytes;
+			if (!toUnsigned(argv[i+1], megabytes) || megabytes == 0){
+				std::cout << "--mem-limit " << argv[i+1] << " does not define a valid size in MB, use e.g. --mem-limit 1024" << std::endl;
+				return 0;
+			}
+			memoryLimit = megabytes << 20;
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--chunks") == 0){
+			if (!toUnsigned(argv[i+1], chunks) || chunks == 0){
+				std::cout << "--chunks " << argv[i+1] << " does not define a valid number of chunks, use e.g. --chunks 64" << std::endl;
+				return 0;
+			}
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--sample") == 0){
+			if (!toUnsigned(argv[i+1], sampleSize) || sampleSize == 0 || sampleSize > 4294967295UL){
+				std::cout << "--sample " << argv[i+1] << " does not define a valid number of sequences, use e.g. --sample 100000" << std::endl;
+				return 0;
+			}
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--p-auto") == 0){
+			double tolerance;
+			if (!toDouble(argv[i+1], tolerance) || tolerance <= 0 || tolerance >= 1){
+				std::cout << "--p-auto " << argv[i+1] << " does not define a valid tolerance within (0,1), use e.g. --p-auto 1e-6" << std::endl;
+				return 0;
+			}
+			Pattern::SetPTolerance(tolerance);
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--sample-error") == 0){
+			double error;
+			if (!toDouble(argv[i+1], error) || error <= 0 || error >= 1){
+				std::cout << "--sample-error " << argv[i+1] << " does not define a valid error within (0,1), use e.g. --sample-error 0.01" << std::endl;
+				return 0;
+			}
+			sampleSize = Sample::SizeForError(error);
+			i += 1;
+			continue;
+		}
+		if (std::strcmp(argv[i], "--seed") == 0){
+			if (!toUnsigned(argv[i+1], seed)){
+				std::cout << "--seed " << argv[i+1] << " does not define a valid seed, use e.g. --seed 42" << std::endl;
+				return 0;
+			}
+			i += 1;
+			continue;
+		}
 		if (std::strlen(argv[i]) != 2 or argv[i][0] != '-') continue;
 		switch(argv[i][1]){
+				case 's':
+				case 'e':
+				case 'd':
+				case 'c':
+				case 'n':
+				case 'N':
+				case 'p':
+				case 'P':
+				case 'l':
+				case 'L':
+			#ifdef SIGSPAN
+				case 'b':
+				case 'i':
+				case 'I':
+			#endif
+					columns.push_back(argv[i][1]);
+					break;
 				case 'v':
 					verbose = 1;
 					break;
@@ -130,113 +630,240 @@ int main(int argc, char** argv)
 					}
 					i += 1;
 					break;
+				case 'R':
+					if (!toUnsigned(argv[i+1], permutations) || permutations == 0){
+						std::cout << "-R " << argv[i+1] << " does not define a valid number of permutations, use e.g. -R 1000" << std::endl;
+						return 0;
+					}
+					i += 1;
+					break;
+				case 'j':
+					if (!toUnsigned(argv[i+1], threads) || threads == 0){
+						std::cout << "-j " << argv[i+1] << " does not define a valid number of threads, use e.g. -j 8" << std::endl;
+						return 0;
+					}
+					i += 1;
+					break;
 		}
 	}
 
+	// Loading text data to score it in parallel is opt-in, the permutation
+	// test, chunks and data in memory use all cores by default
+	bool parallelLoad = threads > 1;
+	if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// Stale or damaged caches are neither read nor overwritten
+	CCache storedC;
+	if (!cacheFilename.empty()){
+		if (storedC.Open(cacheFilename, Pattern::CMethodId())){
+			Pattern::SetStoredC(&storedC);
+			if (verbose >= 1) std::cout << storedC.Size() << " permutation probabilities loaded from " << cacheFilename << std::endl;
+		} else {
+			std::cout << cacheFilename << " is not a C cache of this version and method, it is ignored" << std::endl;
+			cacheFilename.clear();
+		}
+	}
+
+	// Map compiled data before the patterns intern their symbols, so the ids
+	// in the file can be used as they are
+	METRIC_PHASE("load_data");
+	PatternSet patterns = PatternSet(verbose);
+	Dataset dataset;
+	bool compiled = Dataset::IsCompiled(argv[argc - 2]);
+	if (compiled && !dataset.Load(argv[argc - 2], patterns.Symbols())){
+		std::cout << argv[argc - 2] << " is not a valid compiled dataset, compile it again" << std::endl;
+		return 0;
+	}
+
+	if (!checkpointFilename.empty() && (compiled || tWestfallYoung != 0)){
+		std::cout << "--checkpoint needs a text data file and cannot be combined with -W" << std::endl;
+		return 0;
+	}
+
+	if (sampleSize != 0 && (compiled || tWestfallYoung != 0 || !checkpointFilename.empty())){
+		std::cout << "--sample needs a text data file and cannot be combined with -W or --checkpoint" << std::endl;
+		return 0;
+	}
+
+	if (deferred && !checkpointFilename.empty()){
+		std::cout << "--deferred-c cannot be combined with --checkpoint" << std::endl;
+		return 0;
+	}
+	// Below 1/alpha permutations no min-p can be allowed under the threshold
+	if (tWestfallYoung != 0 && std::floor(tWestfallYoung * permutations + 1e-9) == 0){
+		std::cout << "-W " << tWestfallYoung << " needs at least " << std::ceil(1 / tWestfallYoung - 1e-9) << " permutations, use e.g. -R " << std::max(100.0, std::ceil(1 / tWestfallYoung - 1e-9)) << std::endl;
+		return 0;
+	}
+
+	if (onlySignificant && tBonferroni == 0 && tWestfallYoung == 0){
+		std::cout << "--only-significant needs a threshold from -B or -W" << std::endl;
+		return 0;
+	}
+
+	// The trace prints every occurrence probability as it is computed
+	Pattern::SetDeferred(deferred && verbose < 2);
+
+	// Only maintain the statistics the output needs, the trace shows everything
+	StatisticsPlan plan = (verbose >= 2 ? StatisticsPlan() : StatisticsPlan(columns, tWestfallYoung != 0));
+	// The error of sampled estimates needs the moments
+	if (sampleSize != 0) plan.moments = true;
+	// Patterns are selected on their exact p-value
+	if (onlySignificant || topK != 0) plan.distribution = true;
+
+	if (memoryLimit != 0){
+		if (tWestfallYoung != 0 || !checkpointFilename.empty() || sampleSize != 0){
+			std::cout << "--mem-limit cannot be combined with -W, --checkpoint or --sample" << std::endl;
+			return 0;
+		}
+		scoreInBlocks(patterns, dataset, compiled, argv[argc - 2], argv[argc - 1], memoryLimit, plan, columns, tBonferroni, onlySignificant, topK, threads, verbose, outputFile);
+		finishRun(metricsFilename, cacheFilename);
+		return 0;
+	}
+
 	// Load Patterns
+	METRIC_PHASE("load_patterns");
 	FileReader patternFile = FileReader(argv[argc - 1], ' ', '\n', false);
-	std::vector<Pattern> patterns;
 	std::vector<std::string> newSymbol;
 	while (patternFile.Line(newSymbol)){
-		patterns.push_back(Pattern(newSymbol, verbose));
+		patterns.Add(newSymbol);
 	}
-	if (verbose >= 1) std::cout << patterns.size() << " patterns loaded." << std::endl;
+	if (verbose >= 1) std::cout << patterns.Size() << " patterns loaded." << std::endl;
 
-	// Iterate sequences
-	FileReader sequenceFile = FileReader(argv[argc - 2], ' ', '\n', false);
-	std::map<unsigned int, unsigned int> databaseShape = applyFileToPatterns(&patterns, &sequenceFile, false, verbose);
+	// Iterate sequences, compiled data, multiple threads and the permutation test
+	// need them in memory
+	METRIC_PHASE("pass");
+	std::map<unsigned int, unsigned int> databaseShape;
+	bool inMemory = compiled;
+	std::map<unsigned int, uint64_t> populationShape;
+	uint64_t population = 0;
+	if (!checkpointFilename.empty()){
+		// Continue the checkpointed sums with the complete lines appended since,
+		// keeping every statistic as later runs may ask for other columns
+		Checkpoint checkpoint(checkpointFilename);
+		uint64_t end;
+		std::string error;
+		if (!Checkpoint::CompleteLines(argv[argc - 2], end)){
+			std::cout << "--checkpoint needs " << argv[argc - 2] << " to be a regular file" << std::endl;
+			return 0;
+		}
+		if (!checkpoint.Restore(patterns, databaseShape, argv[argc - 2], error)){
+			std::cout << "Checkpoint " << checkpointFilename << " cannot be continued, " << error << std::endl;
+			return 0;
+		}
+		if (verbose >= 1) std::cout << "Continuing from byte " << checkpoint.Offset() << " up to " << end << "." << std::endl;
+		plan = StatisticsPlan();
+		for (auto const& x: applyRangeToPatterns(&patterns, argv[argc - 2], checkpoint.Offset(), end, plan, threads, verbose)){
+			databaseShape[x.first] += x.second;
+		}
+		if (!checkpoint.Store(patterns, databaseShape, argv[argc - 2], end)){
+			std::cout << "Could not write checkpoint " << checkpointFilename << std::endl;
+		}
+
+		if (verifyCheckpoint){
+			// Sums continue in sequence order, so a full run gives the same bits
+			PatternSet full(patterns.Symbols(), 0);
+			for (auto const& p: patterns.Patterns()){
+				full.Add(p.Symbols());
+			}
+			std::map<unsigned int, unsigned int> fullShape = applyRangeToPatterns(&full, argv[argc - 2], 0, end, plan, threads, 0);
+			unsigned int differences = (fullShape == databaseShape ? 0 : 1);
+			for (unsigned int i = 0; i < patterns.Size(); ++i){
+				std::ostringstream incremental, rerun;
+				patterns.Patterns()[i].WriteState(incremental);
+				full.Patterns()[i].WriteState(rerun);
+				if (incremental.str() != rerun.str()){
+					if (differences++ < 10) std::cout << "Checkpoint differs from a full run for " << patterns.Patterns()[i].ToString() << std::endl;
+				}
+			}
+			std::cout << "Checkpoint verification: " << differences << " differences with a full run." << std::endl;
+		}
+	} else if (!compiled){
+		TokenReader sequenceFile(argv[argc - 2], ' ', '\n');
+		std::vector<size_t> splitPoints = sequenceFile.SplitPoints(chunks);
+		if (sampleSize != 0){
+			METRIC_PHASE("load_data");
+			Sample sample(sequenceFile, patterns.Symbols(), sampleSize, seed);
+			dataset = sample.Data();
+			populationShape = sample.Shape();
+			population = sample.Sequences();
+			inMemory = true;
+			METRIC_PHASE("pass");
+		} else if (chunks > 0 && tWestfallYoung == 0 && verbose < 2 && !splitPoints.empty()){
+			databaseShape = applyChunksToPatterns(&patterns, argv[argc - 2], splitPoints, plan, threads, verbose);
+		} else if (parallelLoad || tWestfallYoung != 0){
+			METRIC_PHASE("load_data");
+			dataset = Dataset(sequenceFile, patterns.Symbols());
+			inMemory = true;
+			METRIC_PHASE("pass");
+		} else {
+			databaseShape = applyFileToPatterns(&patterns, &sequenceFile, plan, verbose);
+		}
+	}
+	if (inMemory){
+		if (threads > 1 && verbose < 2){
+			databaseShape = applyDatasetToPatternsParallel(&patterns, &dataset, plan, threads, verbose);
+		} else {
+			databaseShape = applyDatasetToPatterns(&patterns, &dataset, plan, verbose);
+		}
+	}
+	if (Pattern::Deferred()){
+		METRIC_PHASE("deferred_c");
+		evaluateDeferred(&patterns, plan, threads, verbose);
+	}
+	if (sampleSize != 0){
+		// Estimate the statistics of the whole data from the sample
+		if (verbose >= 1) std::cout << "Sampled " << dataset.Sequences() << " of " << population << " sequences." << std::endl;
+		for (auto& p: patterns.Patterns()){
+			p.Scale(population, dataset.Sequences());
+		}
+		// Sequences per length are kept within their 32 bits
+		databaseShape.clear();
+		for (auto const& x: populationShape){
+			databaseShape[x.first] = std::min(x.second, (uint64_t) 4294967295u);
+		}
+	}
+	if (verbose >= 1) PrefixCache::Report(std::cout);
 
 	// Perform significance tests if requested
+	double threshold = 1;
 	if (tBonferroni != 0){
+		threshold = tBonferroni / patterns.Size();
 		std::cout << "Bonferroni significance:" << std::endl;
-		std::cout << "  B(" << tBonferroni << ") = " << tBonferroni / patterns.size() << std::endl;
-		std::cout << "  -log(B(" << tBonferroni << ")) = " << -log(tBonferroni / patterns.size()) << std::endl;
+		std::cout << "  B(" << tBonferroni << ") = " << tBonferroni / patterns.Size() << std::endl;
+		std::cout << "  -log(B(" << tBonferroni << ")) = " << -log(tBonferroni / patterns.Size()) << std::endl;
 		std::cout << std::endl;
 	}
 
 	if (tWestfallYoung != 0){
+		METRIC_PHASE("westfall_young");
 		std::cout << "Westfall-Young significance:" << std::endl;
 
-		std::vector<double> ps;
-		sequenceFile.SetShuffled(true);
-		for (int i = 0; i < 100; ++i){
-			std::cout << "\r" << "(" << i+1 << "/100";
-			sequenceFile.Clear();
-			for (auto& p: patterns){
-				p.Reset();
-			}
-			applyFileToPatterns(&patterns, &sequenceFile, true, verbose);
-			double minP = std::numeric_limits<double>::infinity();
-			for (auto const& p: patterns){
-				minP = std::min(minP, p.PExact());
-			}
-			ps.push_back(minP);
-			std::cout << "\r" << "Sample " << i+1 << "/100" << std::flush;
-		}
-		double threshold = ps[4];
+		WestfallYoung westfallYoung(patterns, dataset, threads, seed);
+		threshold = WestfallYoung::Threshold(westfallYoung.MinPs(permutations), tWestfallYoung);
 
-		std::cout << "\r  W(" << tWestfallYoung << ") = " << threshold << std::endl;
-		std::cout << "  -log(W(" << tWestfallYoung << ")) = " << -log(threshold) << std::endl;
+		if (threshold == 0){
+			// Ties among the smallest min-ps leave no threshold
+			std::cout << "\r  No threshold exists for -W " << tWestfallYoung << " with " << permutations << " permutations, use more with -R" << std::endl;
+		} else {
+			std::cout << "\r  W(" << tWestfallYoung << ") = " << threshold << std::endl;
+			std::cout << "  -log(W(" << tWestfallYoung << ")) = " << -log(threshold) << std::endl;
+		}
 		std::cout << std::endl;
 	}
 
 	// Output results per pattern
+	METRIC_PHASE("output");
+	#ifdef SIGSPAN
+	if (plan.symbolTotals) patterns.ComputeSigspan(databaseShape);
+	#endif
 	std::ostream& out_stream = (outputFile.is_open() ? outputFile : std::cout);
-	for (auto const& p: patterns){
-		std::ostringstream resultString;
-		for (unsigned int i = 1; i <= argc-3; ++i){
-			if (std::strlen(argv[i]) != 2 or argv[i][0] != '-') continue;
-			switch(argv[i][1]){
-				case 's':
-					resultString << p.Support() << " ";
-					break;
-				case 'e':
-					resultString << p.ExpectedValue() << " ";
-					break;
-				case 'd':
-					resultString << p.StandardDeviation() << " ";
-					break;
-				case 'c':
-					resultString << p.NonZeroSequences() << " ";
-					break;
-				case 'n':
-					resultString << p.PNormal() << " ";
-					break;
-				case 'N':
-					resultString << -log(p.PNormal()) << " ";
-					break;
-				case 'p':
-					resultString << p.PExact() << " ";
-					break;
-				case 'P':
-					resultString << -log(p.PExact()) << " ";
-					break;
-				case 'l':
-					resultString << p.PPoisson() << " ";
-					break;
-				case 'L':
-					resultString << -log(p.PPoisson()) << " ";
-					break;
-			#ifdef SIGSPAN
-				case 'b':
-					resultString << p.ExpectedValueSigspan(databaseShape) << " ";
-					break;
-				case 'i':
-					resultString << p.PSigspan(databaseShape) << " ";
-					break;
-				case 'I':
-					resultString << -log(p.PSigspan(databaseShape)) << " ";
-					break;
-			#endif
-				case 'o':
-					i +=1;
-					break;
-			}
-		}
-		if (resultString.str() != "")
-			out_stream << resultString.str() << p.ToString() << std::endl;
-	}
+	ResultFilter filter(onlySignificant ? threshold : 1, topK);
+	writeResults(patterns.Patterns(), 0, columns, databaseShape, filter, out_stream);
+	filter.Flush(out_stream);
+	if (filter.Active()) filter.Report(std::cout);
 	if (outputFile.is_open()){
 		outputFile.close();
 	}
+
+	finishRun(metricsFilename, cacheFilename);
 }